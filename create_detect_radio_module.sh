@@ -30,6 +30,7 @@ SRC_DIR=$WORK_DIR/src
 mkdir -p $SRC_DIR
 
 cp -p $CURRENT_DIR/detect_radio_module/* $SRC_DIR
+cp -p $CURRENT_DIR/kernel/hm_crc.h $SRC_DIR
 
 function build_binaries {
   ARCH=$1
@@ -17,31 +17,12 @@
  */
 
 #include "hmframe.h"
+#include "hm_crc.h"
 #include <string.h>
 
 uint16_t HMFrame::crc(unsigned char *buffer, uint16_t len)
 {
-    uint16_t crc = 0xd77f;
-    int i;
-
-    while (len--)
-    {
-        crc ^= *buffer++ << 8;
-        for (i = 0; i < 8; i++)
-        {
-            if (crc & 0x8000)
-            {
-                crc <<= 1;
-                crc ^= 0x8005;
-            }
-            else
-            {
-                crc <<= 1;
-            }
-        }
-    }
-
-    return crc;
+    return hm_crc(buffer, len);
 }
 
 bool HMFrame::TryParse(unsigned char *buffer, uint16_t len, HMFrame *frame)
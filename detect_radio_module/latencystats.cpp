@@ -0,0 +1,116 @@
+/*
+ *  Copyright 2025 Alexander Reinert
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <string.h>
+#include "latencystats.h"
+
+// Upper bounds of the histogram buckets in ms, the last bucket takes everything above
+static const uint32_t bucketLimits[LATENCY_STATS_BUCKETS - 1] = {5, 10, 20, 50, 100, 200, 500, 1000, 2000};
+
+int LatencyStats::getCommandIndex(uint8_t destination, uint8_t command)
+{
+    int i;
+
+    for (i = 0; i < _commandCount; i++)
+    {
+        if (_commands[i].destination == destination && _commands[i].command == command)
+            return i;
+    }
+
+    if (_commandCount == LATENCY_STATS_MAX_COMMANDS)
+        return -1;
+
+    memset(&_commands[i], 0, sizeof(command_stats_t));
+    _commands[i].destination = destination;
+    _commands[i].command = command;
+    _commands[i].minLatency = UINT32_MAX;
+    _commandCount++;
+    return i;
+}
+
+void LatencyStats::frameSent(uint8_t counter, uint8_t destination, uint8_t command)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+
+    int index = getCommandIndex(destination, command);
+    if (index < 0)
+        return;
+
+    _commands[index].sent++;
+    _pending[counter].pending = true;
+    _pending[counter].commandIndex = index;
+    _pending[counter].sentAt = std::chrono::steady_clock::now();
+}
+
+void LatencyStats::frameReceived(uint8_t counter, uint8_t destination)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+
+    pending_frame_t *pending = &_pending[counter];
+    if (!pending->pending || _commands[pending->commandIndex].destination != destination)
+        return;
+
+    pending->pending = false;
+
+    command_stats_t *stats = &_commands[pending->commandIndex];
+    uint32_t latency = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - pending->sentAt).count();
+    int bucket = 0;
+
+    while (bucket < LATENCY_STATS_BUCKETS - 1 && latency > bucketLimits[bucket] * 1000)
+        bucket++;
+
+    stats->received++;
+    stats->buckets[bucket]++;
+    stats->sumLatency += latency;
+    if (latency < stats->minLatency)
+        stats->minLatency = latency;
+    if (latency > stats->maxLatency)
+        stats->maxLatency = latency;
+}
+
+void LatencyStats::print(FILE *stream, const char *deviceType)
+{
+    std::lock_guard<std::mutex> lock(_lock);
+    char label[16];
+    int i, j;
+
+    fprintf(stream, "Round trip latency per command (%s)\n", deviceType);
+    fprintf(stream, "dst cmd  sent recv  min[ms]  avg[ms]  max[ms]");
+    for (j = 0; j < LATENCY_STATS_BUCKETS; j++)
+    {
+        if (j < LATENCY_STATS_BUCKETS - 1)
+            snprintf(label, sizeof(label), "<=%u", bucketLimits[j]);
+        else
+            snprintf(label, sizeof(label), ">%u", bucketLimits[j - 1]);
+        fprintf(stream, " %6s", label);
+    }
+    fputs("\n", stream);
+
+    for (i = 0; i < _commandCount; i++)
+    {
+        command_stats_t *stats = &_commands[i];
+
+        fprintf(stream, "%02x  %02x  %5u %4u", stats->destination, stats->command, stats->sent, stats->received);
+        if (stats->received > 0)
+            fprintf(stream, " %8.1f %8.1f %8.1f", stats->minLatency / 1000.0, stats->sumLatency / 1000.0 / stats->received, stats->maxLatency / 1000.0);
+        else
+            fprintf(stream, " %8s %8s %8s", "-", "-", "-");
+
+        for (j = 0; j < LATENCY_STATS_BUCKETS; j++)
+            fprintf(stream, " %6u", stats->buckets[j]);
+        fputs("\n", stream);
+    }
+}
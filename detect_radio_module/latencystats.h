@@ -0,0 +1,61 @@
+/*
+ *  Copyright 2025 Alexander Reinert
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+#include <chrono>
+#include <mutex>
+
+#define LATENCY_STATS_MAX_COMMANDS 16
+#define LATENCY_STATS_BUCKETS 10
+
+// Round trip latency histogram per (destination, command) of sent HM frames
+class LatencyStats
+{
+private:
+    typedef struct
+    {
+        uint8_t destination;
+        uint8_t command;
+        uint32_t sent;
+        uint32_t received;
+        uint32_t buckets[LATENCY_STATS_BUCKETS];
+        uint32_t minLatency;
+        uint32_t maxLatency;
+        uint64_t sumLatency;
+    } command_stats_t;
+
+    typedef struct
+    {
+        bool pending;
+        int commandIndex;
+        std::chrono::steady_clock::time_point sentAt;
+    } pending_frame_t;
+
+    command_stats_t _commands[LATENCY_STATS_MAX_COMMANDS];
+    int _commandCount = 0;
+    pending_frame_t _pending[256] = {};
+    std::mutex _lock;
+
+    int getCommandIndex(uint8_t destination, uint8_t command);
+
+public:
+    void frameSent(uint8_t counter, uint8_t destination, uint8_t command);
+    void frameReceived(uint8_t counter, uint8_t destination);
+    void print(FILE *stream, const char *deviceType);
+};
@@ -24,6 +24,7 @@
 #include <sys/ioctl.h>
 #include "radiomoduleconnector.h"
 #include "radiomoduledetector.h"
+#include "radiomodulecache.h"
 
 #define MAX_DEVICE_TYPE_LEN 64
 #define IOCTL_MAGIC 'u'
@@ -31,8 +32,10 @@
 #define IOCTL_IOCGDEVINFO _IOW(IOCTL_MAGIC, 0x82, char[MAX_DEVICE_TYPE_LEN])
 
 void handleFrame(unsigned char *buffer, uint16_t len);
-void readThreadProc(int fd, StreamParser *sp);
+void readThreadProc(int fd, int stopEventFd, StreamParser *sp);
 void log(const char *text, ...);
+void printError(bool json, const char *text, ...);
+std::string jsonEscape(const char *text);
 
 int _fd;
 
@@ -40,31 +43,61 @@ bool debug = false;
 
 int main(int argc, char *argv[])
 {
-  if ((argc >= 2) && (strcmp(argv[1], "--debug") == 0))
+  detect_options_t options;
+  LatencyStats stats;
+  bool printStats = false;
+  bool json = false;
+  const char *cachePath = NULL;
+  int argi;
+
+  for (argi = 1; argi < argc && strncmp(argv[argi], "--", 2) == 0; argi++)
   {
-    debug = true;
+    if (strcmp(argv[argi], "--debug") == 0)
+      debug = true;
+    else if (strcmp(argv[argi], "--pipelined") == 0)
+      options.pipelined = true;
+    else if (strcmp(argv[argi], "--stats") == 0)
+      printStats = true;
+    else if (strcmp(argv[argi], "--json") == 0)
+      json = true;
+    else if (strcmp(argv[argi], "--cache") == 0 && argi + 1 < argc)
+      cachePath = argv[++argi];
+    else if (strcmp(argv[argi], "--identify-timeout") == 0 && argi + 1 < argc)
+      options.identifyTimeout = atoi(argv[++argi]);
+    else if (strcmp(argv[argi], "--identify-retries") == 0 && argi + 1 < argc)
+      options.identifyRetries = atoi(argv[++argi]);
+    else if (strcmp(argv[argi], "--query-timeout") == 0 && argi + 1 < argc)
+      options.queryTimeout = atoi(argv[++argi]);
+    else if (strcmp(argv[argi], "--query-retries") == 0 && argi + 1 < argc)
+      options.queryRetries = atoi(argv[++argi]);
+    else
+      break;
   }
 
-  if (argc != (debug ? 3 : 2))
+  if (argi != argc - 1 || options.identifyTimeout <= 0 || options.identifyRetries <= 0 || options.queryTimeout <= 0 || options.queryRetries < 0)
   {
-    printf("Usage: %s [--debug] <path>\n", argv[0]);
+    printf("Usage: %s [--debug] [--json] [--cache <file>] [--pipelined] [--stats] [--identify-timeout <ms>] [--identify-retries <n>] [--query-timeout <ms>] [--query-retries <n>] <path>\n", argv[0]);
     return -1;
   }
 
-  char *path = argv[debug ? 2 : 1];
+  if (printStats)
+    options.stats = &stats;
+
+  char *path = argv[argi];
 
   int fd = open(path, O_RDWR | O_NOCTTY | O_SYNC);
   if (fd < 0)
   {
-    close(fd);
-    printf("%s could not be opened\n", path);
+    printError(json, "%s could not be opened", path);
     return -1;
   }
 
-  unsigned char deviceType[MAX_DEVICE_TYPE_LEN];
+  char deviceType[MAX_DEVICE_TYPE_LEN] = "unknown";
+  bool hasDeviceType = false;
   if (!ioctl(fd, IOCTL_IOCGDEVINFO, deviceType))
   {
     log("Raw UART device: %s", deviceType);
+    hasDeviceType = true;
   }
   else
   {
@@ -79,48 +112,79 @@ int main(int argc, char *argv[])
     }
   }
 
-  if (ioctl(fd, IOCTL_IOCRESET_RADIO_MODULE))
+  RadioModuleConnector connector(fd);
+  RadioModuleDetector detector;
+  radio_module_info_t info;
+  bool cached = false;
+
+  if (cachePath && hasDeviceType && loadCachedRadioModuleInfo(cachePath, deviceType, &info))
   {
-    switch (errno)
+    // A running app answers the SGTIN and version queries directly, no need to reset and restart the module
+    if (connector.start() && detector.readSGTINAndVersion(&connector, &options) && strcmp(detector.getSGTIN(), info.sgtin) == 0 &&
+        memcmp(detector.getFirmwareVersion(), info.firmwareVersion, sizeof(info.firmwareVersion)) == 0)
     {
-    case EBUSY:
-      close(fd);
-      printf("Raw UART device is in use, aborting.\n");
-      return -1;
-    case ENOTTY:
-      log("Resetting radio module via current device is not supported.");
-      break;
-    case ENOSYS:
-      log("Resetting radio module is not supported.");
-      break;
-    default:
-      log("Reset of radio module failed (%d).", errno);
-      break;
+      log("Radio module matches cached detection result.");
+      cached = true;
+    }
+    else
+    {
+      log("Radio module does not match cached detection result.");
     }
+    connector.stop();
   }
-  else
+
+  if (!cached)
   {
-    log("Sucessfully resetted radio module.");
-  }
+    if (ioctl(fd, IOCTL_IOCRESET_RADIO_MODULE))
+    {
+      switch (errno)
+      {
+      case EBUSY:
+        close(fd);
+        printError(json, "Raw UART device is in use, aborting.");
+        return -1;
+      case ENOTTY:
+        log("Resetting radio module via current device is not supported.");
+        break;
+      case ENOSYS:
+        log("Resetting radio module is not supported.");
+        break;
+      default:
+        log("Reset of radio module failed (%d).", errno);
+        break;
+      }
+    }
+    else
+    {
+      log("Sucessfully resetted radio module.");
+    }
 
-  RadioModuleConnector connector(fd);
-  connector.start();
+    if (!connector.start())
+    {
+      close(fd);
+      printError(json, "Error: Could not start reading from the radio module.");
+      return -1;
+    }
+    detector.detectRadioModule(&connector, &options);
+    connector.stop();
 
-  RadioModuleDetector detector;
-  detector.detectRadioModule(&connector);
+    if (!ioctl(fd, IOCTL_IOCRESET_RADIO_MODULE))
+      log("Sucessfully resetted radio module.");
 
-  if (!ioctl(fd, IOCTL_IOCRESET_RADIO_MODULE))
-    log("Sucessfully resetted radio module.");
+    detector.getRadioModuleInfo(&info);
+  }
 
   close(fd);
 
+  if (printStats)
+    stats.print(stderr, deviceType);
+
   const char *moduleType;
-  const char *sgtin = detector.getSGTIN();
 
-  switch (detector.getRadioModuleType())
+  switch (info.radioModuleType)
   {
   case RADIO_MODULE_HMIP_RFUSB:
-    moduleType = (strstr(sgtin, "3014F5AC") == sgtin) ? "HMIP-RFUSB-TK" : "HMIP-RFUSB";
+    moduleType = (strstr(info.sgtin, "3014F5AC") == info.sgtin) ? "HMIP-RFUSB-TK" : "HMIP-RFUSB";
     break;
   case RADIO_MODULE_HM_MOD_RPI_PCB:
     moduleType = "HM-MOD-RPI-PCB";
@@ -129,28 +193,90 @@ int main(int argc, char *argv[])
     moduleType = "RPI-RF-MOD";
     break;
   case RADIO_MODULE_NONE:
-    printf("Error: Radio module was not detected\n");
+    printError(json, "Error: Radio module was not detected");
     return -1;
   case RADIO_MODULE_UNKNOWN:
-    printf("Error: Radio module was found, but did not respond correctly (maybe bricked App in flashrom)\n");
+    printError(json, "Error: Radio module was found, but did not respond correctly (maybe bricked App in flashrom)");
     return -1;
   default:
-    printf("Error: Radio module was found, but type is unknown or not supported (0x%02X)\n", detector.getRadioModuleType());
+    printError(json, "Error: Radio module was found, but type is unknown or not supported (0x%02X)", info.radioModuleType);
     return -1;
   }
-  const uint8_t *firmwareVersion = detector.getFirmwareVersion();
-  printf("%s %s %s 0x%06X 0x%06X %d.%d.%d\n", moduleType, detector.getSerial(), sgtin, detector.getBidCosRadioMAC(), detector.getHmIPRadioMAC(), firmwareVersion[0], firmwareVersion[1], firmwareVersion[2]);
+
+  // Only modules with SGTIN can be validated on the next start
+  if (cachePath && hasDeviceType && !cached && strcmp(info.sgtin, "n/a") != 0)
+  {
+    if (!saveCachedRadioModuleInfo(cachePath, deviceType, &info))
+      log("Could not write cache file %s.", cachePath);
+  }
+
+  if (json)
+  {
+    printf("{\"device_type\": \"%s\", \"module_type\": \"%s\", \"serial\": \"%s\", \"sgtin\": \"%s\", \"bidcos_radio_mac\": \"0x%06X\", \"hmip_radio_mac\": \"0x%06X\", \"firmware_version\": \"%d.%d.%d\", \"cached\": %s}\n",
+           jsonEscape(hasDeviceType ? deviceType : "").c_str(), jsonEscape(moduleType).c_str(), jsonEscape(info.serial).c_str(), jsonEscape(info.sgtin).c_str(), info.bidCosRadioMAC, info.hmIPRadioMAC, info.firmwareVersion[0], info.firmwareVersion[1], info.firmwareVersion[2], cached ? "true" : "false");
+  }
+  else
+  {
+    printf("%s %s %s 0x%06X 0x%06X %d.%d.%d\n", moduleType, info.serial, info.sgtin, info.bidCosRadioMAC, info.hmIPRadioMAC, info.firmwareVersion[0], info.firmwareVersion[1], info.firmwareVersion[2]);
+  }
   return 0;
 }
 
+void printError(bool json, const char *text, ...)
+{
+  char message[256];
+
+  va_list args;
+  va_start(args, text);
+  vsnprintf(message, sizeof(message), text, args);
+  va_end(args);
+
+  if (json)
+    printf("{\"error\": \"%s\"}\n", jsonEscape(message).c_str());
+  else
+    puts(message);
+}
+
+std::string jsonEscape(const char *text)
+{
+  std::string escaped;
+
+  for (const unsigned char *c = (const unsigned char *)text; *c; c++)
+  {
+    if (*c == '"' || *c == '\\')
+    {
+      escaped += '\\';
+      escaped += *c;
+    }
+    else if (*c < 0x20)
+    {
+      char buf[7];
+      snprintf(buf, sizeof(buf), "\\u%04x", *c);
+      escaped += buf;
+    }
+    else
+    {
+      escaped += *c;
+    }
+  }
+
+  return escaped;
+}
+
 bool sem_wait_timeout(sem_t *sem, int timeout)
 {
   int s;
   struct timespec ts;
-  clock_gettime(CLOCK_REALTIME, &ts);
-  ts.tv_sec += timeout;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  ts.tv_sec += timeout / 1000;
+  ts.tv_nsec += (timeout % 1000) * 1000000L;
+  if (ts.tv_nsec >= 1000000000L)
+  {
+    ts.tv_sec++;
+    ts.tv_nsec -= 1000000000L;
+  }
 
-  while ((s = sem_timedwait(sem, &ts)) == -1 && errno == EINTR)
+  while ((s = sem_clockwait(sem, CLOCK_MONOTONIC, &ts)) == -1 && errno == EINTR)
   {
     continue;
   }
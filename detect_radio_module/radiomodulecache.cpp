@@ -0,0 +1,108 @@
+/*
+ *  Copyright 2025 Alexander Reinert
+ *
+ *  Licensed under the Apache License, Version 2.0 (the "License");
+ *  you may not use this file except in compliance with the License.
+ *  You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *  Unless required by applicable law or agreed to in writing, software
+ *  distributed under the License is distributed on an "AS IS" BASIS,
+ *  WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *  See the License for the specific language governing permissions and
+ *  limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <string>
+#include "radiomodulecache.h"
+
+bool loadCachedRadioModuleInfo(const char *path, const char *deviceType, radio_module_info_t *info)
+{
+    char line[128];
+    char value[64];
+    unsigned int radioModuleType, firmwareVersion[3];
+    int found = 0;
+
+    FILE *file = fopen(path, "r");
+    if (!file)
+        return false;
+
+    memset(info, 0, sizeof(radio_module_info_t));
+
+    while (fgets(line, sizeof(line), file))
+    {
+        line[strcspn(line, "\n")] = 0;
+
+        if (sscanf(line, "device_type=%63[^\n]", value) == 1)
+        {
+            if (strcmp(value, deviceType) != 0)
+                break;
+            found |= 1;
+        }
+        else if (sscanf(line, "radio_module_type=%u", &radioModuleType) == 1)
+        {
+            info->radioModuleType = (radio_module_type_t)radioModuleType;
+            found |= 2;
+        }
+        else if (sscanf(line, "serial=%10s", info->serial) == 1)
+        {
+            found |= 4;
+        }
+        else if (sscanf(line, "sgtin=%24s", info->sgtin) == 1)
+        {
+            found |= 8;
+        }
+        else if (sscanf(line, "bidcos_radio_mac=%x", &info->bidCosRadioMAC) == 1)
+        {
+            found |= 16;
+        }
+        else if (sscanf(line, "hmip_radio_mac=%x", &info->hmIPRadioMAC) == 1)
+        {
+            found |= 32;
+        }
+        else if (sscanf(line, "firmware_version=%u.%u.%u", &firmwareVersion[0], &firmwareVersion[1], &firmwareVersion[2]) == 3)
+        {
+            info->firmwareVersion[0] = firmwareVersion[0];
+            info->firmwareVersion[1] = firmwareVersion[1];
+            info->firmwareVersion[2] = firmwareVersion[2];
+            found |= 64;
+        }
+    }
+
+    fclose(file);
+
+    return found == 127;
+}
+
+bool saveCachedRadioModuleInfo(const char *path, const char *deviceType, radio_module_info_t *info)
+{
+    // Written to a temporary file first, so a power loss during boot can't leave a truncated cache
+    std::string tmpPath = std::string(path) + ".tmp";
+
+    FILE *file = fopen(tmpPath.c_str(), "w");
+    if (!file)
+        return false;
+
+    fprintf(file, "device_type=%s\n", deviceType);
+    fprintf(file, "radio_module_type=%u\n", info->radioModuleType);
+    fprintf(file, "serial=%s\n", info->serial);
+    fprintf(file, "sgtin=%s\n", info->sgtin);
+    fprintf(file, "bidcos_radio_mac=0x%06X\n", info->bidCosRadioMAC);
+    fprintf(file, "hmip_radio_mac=0x%06X\n", info->hmIPRadioMAC);
+    fprintf(file, "firmware_version=%d.%d.%d\n", info->firmwareVersion[0], info->firmwareVersion[1], info->firmwareVersion[2]);
+
+    bool ok = fflush(file) == 0 && fsync(fileno(file)) == 0;
+    ok = (fclose(file) == 0) && ok;
+
+    if (!ok || rename(tmpPath.c_str(), path) != 0)
+    {
+        unlink(tmpPath.c_str());
+        return false;
+    }
+
+    return true;
+}
@@ -17,22 +17,54 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/eventfd.h>
 #include "radiomoduleconnector.h"
 #include "hmframe.h"
 
 static const char *TAG = "RadioModuleConnector";
 
-void readThreadProc(int fd, StreamParser *sp)
+#define READ_BUFFER_SIZE 4096
+
+void readThreadProc(int fd, int stopEventFd, StreamParser *sp)
 {
-  int len;
-  unsigned char buf[1];
+  unsigned char buf[READ_BUFFER_SIZE];
+  struct pollfd fds[2];
+
+  fds[0].fd = fd;
+  fds[0].events = POLLIN;
+  fds[1].fd = stopEventFd;
+  fds[1].events = POLLIN;
 
   while (true)
   {
-    int len = read(fd, buf, 1);
-    if (len > 0)
+    if (poll(fds, 2, -1) < 0)
     {
-      sp->append(buf[0]);
+      if (errno == EINTR)
+        continue;
+      break;
+    }
+
+    if (fds[1].revents)
+      break;
+
+    if (fds[0].revents & POLLIN)
+    {
+      int len = read(fd, buf, sizeof(buf));
+      if (len > 0)
+      {
+        sp->append(buf, len);
+      }
+      else if (len == 0 || (errno != EAGAIN && errno != EINTR))
+      {
+        // EOF, e.g. after the device was unplugged
+        break;
+      }
+    }
+    else if (fds[0].revents & (POLLERR | POLLHUP | POLLNVAL))
+    {
+      break;
     }
   }
 }
@@ -72,14 +104,43 @@ RadioModuleConnector::RadioModuleConnector(int fd) : _fd(fd)
   }
 }
 
-void RadioModuleConnector::start()
+RadioModuleConnector::~RadioModuleConnector()
+{
+  stop();
+  delete _streamParser;
+}
+
+bool RadioModuleConnector::start()
 {
-  _reader = new std::thread(readThreadProc, _fd, _streamParser);
-  _reader->detach();
+  if (_reader)
+    return true;
+
+  _stopEventFd = eventfd(0, EFD_CLOEXEC);
+  if (_stopEventFd < 0)
+  {
+    fprintf(stderr, "%s: Could not create stop event (%s)\n", TAG, strerror(errno));
+    return false;
+  }
+
+  _reader = new std::thread(readThreadProc, _fd, _stopEventFd, _streamParser);
+  return true;
 }
 
 void RadioModuleConnector::stop()
 {
+  if (!_reader)
+    return;
+
+  uint64_t value = 1;
+  while (write(_stopEventFd, &value, sizeof(value)) < 0 && errno == EINTR)
+    continue;
+
+  _reader->join();
+  delete _reader;
+  _reader = NULL;
+
+  close(_stopEventFd);
+  _stopEventFd = -1;
 }
 
 void RadioModuleConnector::setFrameHandler(FrameHandler *frameHandler, bool decodeEscaped)
@@ -40,13 +40,15 @@ private:
     FrameHandler *_frameHandler = NULL;
     std::thread *_reader = NULL;
     int _fd;
+    int _stopEventFd = -1;
 
     void _handleFrame(unsigned char *buffer, uint16_t len);
 
 public:
     RadioModuleConnector(int fd);
+    ~RadioModuleConnector();
 
-    void start();
+    bool start();
     void stop();
 
     void setFrameHandler(FrameHandler *handler, bool decodeEscaped);
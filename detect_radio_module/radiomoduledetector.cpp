@@ -24,9 +24,87 @@
 
 static const char *TAG = "RadioModuleConnector";
 
-void RadioModuleDetector::detectRadioModule(RadioModuleConnector *radioModuleConnector)
+typedef struct
+{
+    uint8_t destination;
+    uint8_t ackCommand;
+    uint8_t ackStatus;
+    const char *name;
+    uint16_t nameLen;
+    bool isBootloader;
+    uint8_t switchDestination;
+    uint8_t switchCommand;
+    detect_radio_module_state_t nextState;
+} identify_response_t;
+
+#define IDENTIFY_RESPONSE(__dst, __ackCmd, __ackStatus, __name, __isBootloader, __switchDst, __switchCmd, __nextState) \
+    {__dst, __ackCmd, __ackStatus, __name, sizeof(__name) - 1, __isBootloader, __switchDst, __switchCmd, __nextState}
+
+// Known identify responses, switch* is the command to change into the other firmware (bootloader <-> app)
+static constexpr identify_response_t identifyResponses[] = {
+    IDENTIFY_RESPONSE(HM_DST_COMMON, HM_CMD_COMMON_ACK, 1, "HMIP_TRX_Bl", true, HM_DST_COMMON, HM_CMD_COMMON_START_APP, DETECT_STATE_START_APP),
+    IDENTIFY_RESPONSE(HM_DST_HMSYSTEM, HM_CMD_HMSYSTEM_ACK, 2, "Co_CPU_BL", true, HM_DST_HMSYSTEM, HM_CMD_HMSYSTEM_CHANGE_APP, DETECT_STATE_START_APP),
+    IDENTIFY_RESPONSE(HM_DST_COMMON, HM_CMD_COMMON_ACK, 1, "DualCoPro_App", false, HM_DST_COMMON, HM_CMD_COMMON_START_BL, DETECT_STATE_GET_MCU_TYPE),
+    IDENTIFY_RESPONSE(HM_DST_COMMON, HM_CMD_COMMON_ACK, 1, "HMIP_TRX_App", false, HM_DST_COMMON, HM_CMD_COMMON_START_BL, DETECT_STATE_GET_MCU_TYPE),
+    IDENTIFY_RESPONSE(HM_DST_HMSYSTEM, HM_CMD_HMSYSTEM_ACK, 2, "Co_CPU_App", false, HM_DST_HMSYSTEM, HM_CMD_HMSYSTEM_CHANGE_APP, DETECT_STATE_LEGACY_GET_VERSION),
+};
+
+// The identify response is either sent as ACK with status byte or as plain frame with command 0
+static const identify_response_t *findIdentifyResponse(HMFrame *frame)
+{
+    for (const identify_response_t &response : identifyResponses)
+    {
+        if (frame->destination != response.destination)
+            continue;
+
+        if (frame->command == response.ackCommand && frame->data_len == response.nameLen + 1 && frame->data[0] == response.ackStatus && memcmp(frame->data + 1, response.name, response.nameLen) == 0)
+            return &response;
+
+        if (frame->command == 0 && frame->data_len == response.nameLen && memcmp(frame->data, response.name, response.nameLen) == 0)
+            return &response;
+    }
+
+    return NULL;
+}
+
+typedef struct
+{
+    detect_radio_module_state_t state;
+    uint8_t destination;
+    uint8_t command;
+    uint8_t ackCommand;
+    uint16_t ackLen;
+    int16_t ackStatus;
+} query_t;
+
+// Queries sent after the app was started, ackStatus -1 accepts any status
+static constexpr query_t queries[] = {
+    {DETECT_STATE_GET_MCU_TYPE, HM_DST_TRX, HM_CMD_TRX_GET_MCU_TYPE, HM_CMD_TRX_ACK, 2, 1},
+    {DETECT_STATE_GET_VERSION, HM_DST_TRX, HM_CMD_TRX_GET_VERSION, HM_CMD_TRX_ACK, 10, 1},
+    {DETECT_STATE_GET_HMIP_RF_ADDRESS, HM_DST_HMIP, HM_CMD_HMIP_GET_DEFAULT_RF_ADDR, HM_CMD_HMIP_ACK, 4, 1},
+    {DETECT_STATE_GET_SGTIN, HM_DST_COMMON, HM_CMD_COMMON_GET_SGTIN, HM_CMD_COMMON_ACK, 13, 1},
+    {DETECT_STATE_GET_BIDCOS_RF_ADDRESS, HM_DST_LLMAC, HM_CMD_LLMAC_GET_DEFAULT_RF_ADDR, HM_CMD_LLMAC_ACK, 4, 1},
+    {DETECT_STATE_GET_SERIAL, HM_DST_LLMAC, HM_CMD_LLMAC_GET_SERIAL, HM_CMD_LLMAC_ACK, 11, 1},
+    {DETECT_STATE_LEGACY_GET_VERSION, HM_DST_HMSYSTEM, HM_CMD_HMSYSTEM_GET_VERSION, HM_CMD_HMSYSTEM_ACK, 7, 2},
+    {DETECT_STATE_LEGACY_GET_BIDCOS_RF_ADDRESS, HM_DST_TRX, HM_CMD_TRX_GET_DEFAULT_RF_ADDR, HM_CMD_TRX_ACK, 6, -1},
+    {DETECT_STATE_LEGACY_GET_SERIAL, HM_DST_HMSYSTEM, HM_CMD_HMSYSTEM_GET_SERIAL, HM_CMD_HMSYSTEM_ACK, 11, 2},
+};
+
+static const query_t *findQuery(int state)
+{
+    for (const query_t &query : queries)
+    {
+        if (query.state == state)
+            return &query;
+    }
+
+    return NULL;
+}
+
+void RadioModuleDetector::detectRadioModule(RadioModuleConnector *radioModuleConnector, detect_options_t *options)
 {
     _radioModuleConnector = radioModuleConnector;
+    _options = *options;
 
     _detectState = DETECT_STATE_START_BL;
     _detectRetryCount = 0;
@@ -36,15 +114,15 @@ void RadioModuleDetector::detectRadioModule(RadioModuleConnector *radioModuleCon
 
     _radioModuleConnector->setFrameHandler(this, true);
 
-    while (_detectState == DETECT_STATE_START_BL && _detectRetryCount < 3)
+    while (_detectState == DETECT_STATE_START_BL && _detectRetryCount < _options.identifyRetries)
     {
         _radioModuleType = RADIO_MODULE_NONE;
 
         sendFrame(_detectMsgCounter++, HM_DST_COMMON, HM_CMD_COMMON_IDENTIFY, NULL, 0);
-        if (!sem_take(_detectWaitFrameDataSemaphore, 3))
+        if (!sem_take(_detectWaitFrameDataSemaphore, _options.identifyTimeout))
         {
             sendFrame(_detectMsgCounter++, HM_DST_HMSYSTEM, HM_CMD_HMSYSTEM_IDENTIFY, NULL, 0);
-            if (!sem_take(_detectWaitFrameDataSemaphore, 3))
+            if (!sem_take(_detectWaitFrameDataSemaphore, _options.identifyTimeout))
             {
                 _detectRetryCount++;
             }
@@ -52,155 +130,315 @@ void RadioModuleDetector::detectRadioModule(RadioModuleConnector *radioModuleCon
     }
 
     _detectRetryCount = 0;
-    while (_detectState == DETECT_STATE_START_APP && _detectRetryCount < 3)
+    while (_detectState == DETECT_STATE_START_APP && _detectRetryCount < _options.identifyRetries)
     {
         sendFrame(_detectMsgCounter++, HM_DST_COMMON, HM_CMD_COMMON_IDENTIFY, NULL, 0);
-        if (!sem_take(_detectWaitFrameDataSemaphore, 3))
+        if (!sem_take(_detectWaitFrameDataSemaphore, _options.identifyTimeout))
         {
             sendFrame(_detectMsgCounter++, HM_DST_HMSYSTEM, HM_CMD_HMSYSTEM_IDENTIFY, NULL, 0);
-            if (!sem_take(_detectWaitFrameDataSemaphore, 3))
+            if (!sem_take(_detectWaitFrameDataSemaphore, _options.identifyTimeout))
             {
                 _detectRetryCount++;
             }
         }
     }
 
+    _detectRetryCount = 0;
+    if (_options.pipelined && (_detectState == DETECT_STATE_GET_MCU_TYPE || _detectState == DETECT_STATE_LEGACY_GET_VERSION))
+    {
+        detectPipelined();
+    }
+
     while (true)
     {
-        switch (_detectState)
+        if (_detectState == DETECT_STATE_START_BL || _detectState == DETECT_STATE_START_APP)
         {
-        case DETECT_STATE_START_BL:
-        case DETECT_STATE_START_APP:
             _detectState = DETECT_STATE_FINISHED;
-            break;
+        }
 
-        case DETECT_STATE_GET_MCU_TYPE:
-            sendFrame(_detectMsgCounter++, HM_DST_TRX, HM_CMD_TRX_GET_MCU_TYPE, NULL, 0);
-            break;
+        const query_t *query = findQuery(_detectState);
+        if (query)
+        {
+            sendFrame(_detectMsgCounter++, query->destination, query->command, NULL, 0);
+        }
 
-        case DETECT_STATE_GET_VERSION:
-            sendFrame(_detectMsgCounter++, HM_DST_TRX, HM_CMD_TRX_GET_VERSION, NULL, 0);
+        if (_detectState == DETECT_STATE_FINISHED)
+        {
             break;
+        }
 
-        case DETECT_STATE_GET_HMIP_RF_ADDRESS:
-            sendFrame(_detectMsgCounter++, HM_DST_HMIP, HM_CMD_HMIP_GET_DEFAULT_RF_ADDR, NULL, 0);
+        if (sem_take(_detectWaitFrameDataSemaphore, _options.queryTimeout))
+        {
+            _detectRetryCount = 0;
+        }
+        else if (_detectRetryCount++ >= _options.queryRetries)
+        {
             break;
+        }
+    }
 
-        case DETECT_STATE_GET_SGTIN:
-            sendFrame(_detectMsgCounter++, HM_DST_COMMON, HM_CMD_COMMON_GET_SGTIN, NULL, 0);
-            break;
+    _radioModuleConnector->setFrameHandler(NULL, false);
+}
 
-        case DETECT_STATE_GET_BIDCOS_RF_ADDRESS:
-            sendFrame(_detectMsgCounter++, HM_DST_LLMAC, HM_CMD_LLMAC_GET_DEFAULT_RF_ADDR, NULL, 0);
-            break;
+bool RadioModuleDetector::readSGTINAndVersion(RadioModuleConnector *radioModuleConnector, detect_options_t *options)
+{
+    // The SGTIN identifies the module, the app firmware version changes on firmware updates
+    const detect_radio_module_state_t queries[] = {DETECT_STATE_GET_SGTIN, DETECT_STATE_GET_VERSION};
+    bool res;
 
-        case DETECT_STATE_GET_SERIAL:
-            sendFrame(_detectMsgCounter++, HM_DST_LLMAC, HM_CMD_LLMAC_GET_SERIAL, NULL, 0);
-            break;
+    _radioModuleConnector = radioModuleConnector;
+    _options = *options;
+    _detectMsgCounter = 0;
 
-        case DETECT_STATE_LEGACY_GET_VERSION:
-            sendFrame(_detectMsgCounter++, HM_DST_HMSYSTEM, HM_CMD_HMSYSTEM_GET_VERSION, NULL, 0);
-            break;
+    sem_init(_detectWaitFrameDataSemaphore);
 
-        case DETECT_STATE_LEGACY_GET_BIDCOS_RF_ADDRESS:
-            sendFrame(_detectMsgCounter++, HM_DST_TRX, HM_CMD_TRX_GET_DEFAULT_RF_ADDR, NULL, 0);
-            break;
+    _radioModuleConnector->setFrameHandler(this, true);
+    res = runPipelinedQueries(queries, 2);
+    _detectState = DETECT_STATE_FINISHED;
+    _radioModuleConnector->setFrameHandler(NULL, false);
 
-        case DETECT_STATE_LEGACY_GET_SERIAL:
-            sendFrame(_detectMsgCounter++, HM_DST_HMSYSTEM, HM_CMD_HMSYSTEM_GET_SERIAL, NULL, 0);
-            break;
+    return res;
+}
 
-        case DETECT_STATE_FINISHED:
-            break;
-        }
+void RadioModuleDetector::detectPipelined()
+{
+    if (_detectState == DETECT_STATE_LEGACY_GET_VERSION)
+    {
+        const detect_radio_module_state_t legacyQueries[] = {DETECT_STATE_LEGACY_GET_VERSION, DETECT_STATE_LEGACY_GET_BIDCOS_RF_ADDRESS, DETECT_STATE_LEGACY_GET_SERIAL};
+        runPipelinedQueries(legacyQueries, 3);
+        _detectState = DETECT_STATE_FINISHED;
+        return;
+    }
 
-        if (_detectState == DETECT_STATE_FINISHED || !sem_take(_detectWaitFrameDataSemaphore, 3))
-        {
-            break;
-        }
+    // SGTIN, BidCoS address and serial are interpreted depending on MCU type and firmware version
+    const detect_radio_module_state_t firstQueries[] = {DETECT_STATE_GET_MCU_TYPE, DETECT_STATE_GET_VERSION, DETECT_STATE_GET_HMIP_RF_ADDRESS};
+    if (!runPipelinedQueries(firstQueries, 3))
+    {
+        _detectState = DETECT_STATE_FINISHED;
+        return;
     }
 
-    _radioModuleConnector->setFrameHandler(NULL, false);
-}
+    detect_radio_module_state_t secondQueries[3];
+    int secondQueryCount = 0;
+    bool hasBidCosRadio = !(_radioModuleType == RADIO_MODULE_HMIP_RFUSB && _firmwareVersion[0] < 4);
 
-void RadioModuleDetector::handleFrame(unsigned char *buffer, uint16_t len)
-{
-    log_frame("Received HM frame:", buffer, len);
+    secondQueries[secondQueryCount++] = DETECT_STATE_GET_SGTIN;
+    if (hasBidCosRadio)
+        secondQueries[secondQueryCount++] = DETECT_STATE_GET_BIDCOS_RF_ADDRESS;
+    if (_radioModuleType == RADIO_MODULE_HM_MOD_RPI_PCB)
+        secondQueries[secondQueryCount++] = DETECT_STATE_GET_SERIAL;
 
-    HMFrame frame;
-    if (!HMFrame::TryParse(buffer, len, &frame))
+    bool hasSGTIN = runPipelinedQueries(secondQueries, secondQueryCount);
+    if (!hasSGTIN)
     {
-        return;
+        // Not all queries were answered, the SGTIN (always first) may still have been
+        std::lock_guard<std::mutex> lock(_pendingLock);
+        hasSGTIN = _pendingQueries[0].answered;
     }
 
-    switch (_detectState)
+    if (hasSGTIN && (_radioModuleType == RADIO_MODULE_RPI_RF_MOD || _radioModuleType == RADIO_MODULE_HMIP_RFUSB))
     {
-    case DETECT_STATE_START_BL:
-        if ((frame.destination == HM_DST_COMMON && frame.command == HM_CMD_COMMON_ACK && frame.data_len == 12 && frame.data[0] == 1 && strncmp((char *)(frame.data + 1), "HMIP_TRX_Bl", 11) == 0) || (frame.destination == HM_DST_COMMON && frame.command == 0 && frame.data_len == 11 && strncmp((char *)(frame.data), "HMIP_TRX_Bl", 11) == 0))
+        sprintf(_serial, "%02X%02X%02X%02X%02X", _sgtinData[7], _sgtinData[8], _sgtinData[9], _sgtinData[10], _sgtinData[11]);
+
+        if (!hasBidCosRadio)
         {
-            // TRX CoPro in bootloader
-            _radioModuleType = RADIO_MODULE_UNKNOWN;
-            _detectState = DETECT_STATE_START_APP;
-            sem_give(_detectWaitFrameDataSemaphore);
+            _bidCosRadioMAC = 0;
         }
-        else if ((frame.destination == HM_DST_HMSYSTEM && frame.command == HM_CMD_HMSYSTEM_ACK && frame.data_len == 10 && frame.data[0] == 2 && strncmp((char *)(frame.data + 1), "Co_CPU_BL", 9) == 0) || (frame.destination == HM_DST_HMSYSTEM && frame.command == 0 && frame.data_len == 9 && strncmp((char *)frame.data, "Co_CPU_BL", 9) == 0))
+        else if (_bidCosRadioMAC == 0)
         {
-            // Legacy CoPro in bootloader
-            _radioModuleType = RADIO_MODULE_UNKNOWN;
-            _detectState = DETECT_STATE_START_APP;
-            sem_give(_detectWaitFrameDataSemaphore);
+            _bidCosRadioMAC = 0xff0000 | (_sgtinData[10] << 8) | _sgtinData[11];
+            if (_bidCosRadioMAC == 0xffffff)
+                _bidCosRadioMAC = 0xfffffe;
         }
-        else if ((frame.destination == HM_DST_COMMON && frame.command == HM_CMD_COMMON_ACK && frame.data_len == 14 && frame.data[0] == 1 && strncmp((char *)(frame.data + 1), "DualCoPro_App", 13) == 0) || (frame.destination == HM_DST_COMMON && frame.command == 0 && frame.data_len == 13 && strncmp((char *)frame.data, "DualCoPro_App", 13) == 0))
+    }
+
+    _detectState = DETECT_STATE_FINISHED;
+}
+
+bool RadioModuleDetector::runPipelinedQueries(const detect_radio_module_state_t *states, int count)
+{
+    int i;
+    int retry;
+    pending_query_t sendQueries[MAX_PIPELINED_QUERIES];
+    int sendCount;
+
+    _pendingLock.lock();
+    _pendingQueryCount = count;
+    _pendingQueryOpen = count;
+    for (i = 0; i < count; i++)
+    {
+        _pendingQueries[i].state = states[i];
+        _pendingQueries[i].answered = false;
+    }
+    _detectState = DETECT_STATE_PIPELINED;
+    _pendingLock.unlock();
+
+    for (retry = 0; retry <= _options.queryRetries; retry++)
+    {
+        _pendingLock.lock();
+        sendCount = 0;
+        for (i = 0; i < _pendingQueryCount; i++)
         {
-            // Dual CoPro in app --> start bootloader
-            _radioModuleType = RADIO_MODULE_UNKNOWN;
-            sendFrame(_detectMsgCounter++, HM_DST_COMMON, HM_CMD_COMMON_START_BL, NULL, 0);
+            if (!_pendingQueries[i].answered)
+            {
+                _pendingQueries[i].counter = _detectMsgCounter++;
+                sendQueries[sendCount++] = _pendingQueries[i];
+            }
         }
-        else if ((frame.destination == HM_DST_COMMON && frame.command == HM_CMD_COMMON_ACK && frame.data_len == 13 && frame.data[0] == 1 && strncmp((char *)(frame.data + 1), "HMIP_TRX_App", 12) == 0) || (frame.destination == HM_DST_COMMON && frame.command == 0 && frame.data_len == 12 && strncmp((char *)frame.data, "HMIP_TRX_App", 12) == 0))
+        _pendingLock.unlock();
+
+        for (i = 0; i < sendCount; i++)
         {
-            // HmIP only in app --> start bootloader
-            _radioModuleType = RADIO_MODULE_UNKNOWN;
-            sendFrame(_detectMsgCounter++, HM_DST_COMMON, HM_CMD_COMMON_START_BL, NULL, 0);
+            const query_t *query = findQuery(sendQueries[i].state);
+            sendFrame(sendQueries[i].counter, query->destination, query->command, NULL, 0);
         }
-        else if ((frame.destination == HM_DST_HMSYSTEM && frame.command == HM_CMD_HMSYSTEM_ACK && frame.data_len == 11 && frame.data[0] == 2 && strncmp((char *)(frame.data + 1), "Co_CPU_App", 10) == 0) || (frame.destination == HM_DST_HMSYSTEM && frame.command == 0 && frame.data_len == 10 && strncmp((char *)frame.data, "Co_CPU_App", 10) == 0))
+
+        while (sem_take(_detectWaitFrameDataSemaphore, _options.queryTimeout))
         {
-            // Legacy CoPro in app --> start bootloader
-            _radioModuleType = RADIO_MODULE_UNKNOWN;
-            sendFrame(_detectMsgCounter++, HM_DST_HMSYSTEM, HM_CMD_HMSYSTEM_CHANGE_APP, NULL, 0);
+            std::lock_guard<std::mutex> lock(_pendingLock);
+            if (_pendingQueryOpen == 0)
+                return true;
         }
-        break;
+    }
 
-    case DETECT_STATE_START_APP:
-        if ((frame.destination == HM_DST_COMMON && frame.command == HM_CMD_COMMON_ACK && frame.data_len == 12 && frame.data[0] == 1 && strncmp((char *)(frame.data + 1), "HMIP_TRX_Bl", 11) == 0) || (frame.destination == HM_DST_COMMON && frame.command == 0 && frame.data_len == 11 && strncmp((char *)(frame.data), "HMIP_TRX_Bl", 11) == 0))
+    return false;
+}
+
+void RadioModuleDetector::handlePipelinedFrame(HMFrame *frame)
+{
+    std::lock_guard<std::mutex> lock(_pendingLock);
+
+    for (int i = 0; i < _pendingQueryCount; i++)
+    {
+        pending_query_t *pending = &_pendingQueries[i];
+        if (pending->answered || pending->counter != frame->counter)
+            continue;
+
+        const query_t *query = findQuery(pending->state);
+        if (frame->destination != query->destination || frame->command != query->ackCommand)
+            continue;
+
+        if (frame->data_len == query->ackLen && (query->ackStatus < 0 || frame->data[0] == query->ackStatus))
         {
-            // TRX CoPro in bootloader --> start app
-            sendFrame(_detectMsgCounter++, HM_DST_COMMON, HM_CMD_COMMON_START_APP, NULL, 0);
+            switch (pending->state)
+            {
+            case DETECT_STATE_GET_MCU_TYPE:
+                _radioModuleType = (radio_module_type_t)frame->data[1];
+                break;
+
+            case DETECT_STATE_GET_VERSION:
+                memcpy(_firmwareVersion, frame->data + 1, 3);
+                break;
+
+            case DETECT_STATE_GET_HMIP_RF_ADDRESS:
+                _hmIPRadioMAC = (frame->data[1] << 16) | (frame->data[2] << 8) | frame->data[3];
+                break;
+
+            case DETECT_STATE_GET_SGTIN:
+                memcpy(_sgtinData, frame->data + 1, 12);
+                sprintf(_sgtin, "%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X%02X", _sgtinData[0], _sgtinData[1], _sgtinData[2], _sgtinData[3], _sgtinData[4], _sgtinData[5], _sgtinData[6], _sgtinData[7], _sgtinData[8], _sgtinData[9], _sgtinData[10], _sgtinData[11]);
+                break;
+
+            case DETECT_STATE_GET_BIDCOS_RF_ADDRESS:
+            {
+                uint32_t radioMac = (frame->data[1] << 16) | (frame->data[2] << 8) | frame->data[3];
+                if (radioMac != 0 && (radioMac & 0xffff) != 0xffff)
+                    _bidCosRadioMAC = radioMac;
+                break;
+            }
+
+            case DETECT_STATE_GET_SERIAL:
+            case DETECT_STATE_LEGACY_GET_SERIAL:
+                memcpy(_serial, frame->data + 1, 10);
+                break;
+
+            case DETECT_STATE_LEGACY_GET_VERSION:
+                memcpy(_firmwareVersion, frame->data + 4, 3);
+                break;
+
+            case DETECT_STATE_LEGACY_GET_BIDCOS_RF_ADDRESS:
+                _bidCosRadioMAC = (frame->data[3] << 16) | (frame->data[4] << 8) | frame->data[5];
+                break;
+
+            default:
+                break;
+            }
         }
-        else if ((frame.destination == HM_DST_HMSYSTEM && frame.command == HM_CMD_HMSYSTEM_ACK && frame.data_len == 10 && frame.data[0] == 2 && strncmp((char *)(frame.data + 1), "Co_CPU_BL", 9) == 0) || (frame.destination == HM_DST_HMSYSTEM && frame.command == 0 && frame.data_len == 9 && strncmp((char *)frame.data, "Co_CPU_BL", 9) == 0))
+        else if (pending->state == DETECT_STATE_GET_BIDCOS_RF_ADDRESS && frame->data_len == 1 && frame->data[0] == 0 && (_radioModuleType == RADIO_MODULE_RPI_RF_MOD || _radioModuleType == RADIO_MODULE_HMIP_RFUSB))
         {
-            // Legacy CoPro in bootloader --> start app
-            sendFrame(_detectMsgCounter++, HM_DST_HMSYSTEM, HM_CMD_HMSYSTEM_CHANGE_APP, NULL, 0);
+            // No dedicated BidCoS address, the one derived from the SGTIN is used
         }
-        else if ((frame.destination == HM_DST_COMMON && frame.command == HM_CMD_COMMON_ACK && frame.data_len == 14 && frame.data[0] == 1 && strncmp((char *)(frame.data + 1), "DualCoPro_App", 13) == 0) || (frame.destination == HM_DST_COMMON && frame.command == 0 && frame.data_len == 13 && strncmp((char *)frame.data, "DualCoPro_App", 13) == 0))
+        else
         {
-            // Dual CoPro in app
-            _detectState = DETECT_STATE_GET_MCU_TYPE;
-            sem_give(_detectWaitFrameDataSemaphore);
+            continue;
         }
-        else if ((frame.destination == HM_DST_COMMON && frame.command == HM_CMD_COMMON_ACK && frame.data_len == 13 && frame.data[0] == 1 && strncmp((char *)(frame.data + 1), "HMIP_TRX_App", 12) == 0) || (frame.destination == HM_DST_COMMON && frame.command == 0 && frame.data_len == 12 && strncmp((char *)frame.data, "HMIP_TRX_App", 12) == 0))
-        {
-            // HmIP only in app
-            _detectState = DETECT_STATE_GET_MCU_TYPE;
+
+        pending->answered = true;
+        if (--_pendingQueryOpen == 0)
             sem_give(_detectWaitFrameDataSemaphore);
+        return;
+    }
+}
+
+void RadioModuleDetector::handleFrame(unsigned char *buffer, uint16_t len)
+{
+    log_frame("Received HM frame:", buffer, len);
+
+    HMFrame frame;
+    const identify_response_t *identifyResponse;
+
+    if (!HMFrame::TryParse(buffer, len, &frame))
+    {
+        return;
+    }
+
+    if (_options.stats)
+        _options.stats->frameReceived(frame.counter, frame.destination);
+
+    switch (_detectState)
+    {
+    case DETECT_STATE_PIPELINED:
+        handlePipelinedFrame(&frame);
+        break;
+
+    case DETECT_STATE_START_BL:
+        identifyResponse = findIdentifyResponse(&frame);
+        if (identifyResponse)
+        {
+            _radioModuleType = RADIO_MODULE_UNKNOWN;
+            if (identifyResponse->isBootloader)
+            {
+                _detectState = identifyResponse->nextState;
+                sem_give(_detectWaitFrameDataSemaphore);
+            }
+            else
+            {
+                // CoPro in app --> start bootloader
+                sendFrame(_detectMsgCounter++, identifyResponse->switchDestination, identifyResponse->switchCommand, NULL, 0);
+            }
         }
-        else if ((frame.destination == HM_DST_HMSYSTEM && frame.command == HM_CMD_HMSYSTEM_ACK && frame.data_len == 11 && frame.data[0] == 2 && strncmp((char *)(frame.data + 1), "Co_CPU_App", 10) == 0) || (frame.destination == HM_DST_HMSYSTEM && frame.command == 0 && frame.data_len == 10 && strncmp((char *)frame.data, "Co_CPU_App", 10) == 0))
+        break;
+
+    case DETECT_STATE_START_APP:
+        identifyResponse = findIdentifyResponse(&frame);
+        if (identifyResponse)
         {
-            // Legacy CoPro in app
-            _detectState = DETECT_STATE_LEGACY_GET_VERSION;
-            sprintf(_sgtin, "n/a");
-            _hmIPRadioMAC = 0;
-            _radioModuleType = RADIO_MODULE_HM_MOD_RPI_PCB;
-            sem_give(_detectWaitFrameDataSemaphore);
+            if (identifyResponse->isBootloader)
+            {
+                // CoPro in bootloader --> start app
+                sendFrame(_detectMsgCounter++, identifyResponse->switchDestination, identifyResponse->switchCommand, NULL, 0);
+            }
+            else
+            {
+                _detectState = identifyResponse->nextState;
+                if (_detectState == DETECT_STATE_LEGACY_GET_VERSION)
+                {
+                    sprintf(_sgtin, "n/a");
+                    _hmIPRadioMAC = 0;
+                    _radioModuleType = RADIO_MODULE_HM_MOD_RPI_PCB;
+                }
+                sem_give(_detectWaitFrameDataSemaphore);
+            }
         }
         break;
 
@@ -355,6 +593,16 @@ radio_module_type_t RadioModuleDetector::getRadioModuleType()
     return _radioModuleType;
 }
 
+void RadioModuleDetector::getRadioModuleInfo(radio_module_info_t *info)
+{
+    info->radioModuleType = _radioModuleType;
+    memcpy(info->serial, _serial, sizeof(info->serial));
+    memcpy(info->sgtin, _sgtin, sizeof(info->sgtin));
+    info->bidCosRadioMAC = _bidCosRadioMAC;
+    info->hmIPRadioMAC = _hmIPRadioMAC;
+    memcpy(info->firmwareVersion, _firmwareVersion, sizeof(info->firmwareVersion));
+}
+
 void RadioModuleDetector::sendFrame(uint8_t counter, uint8_t destination, uint8_t command, unsigned char *data, uint data_len)
 {
     HMFrame frame;
@@ -369,5 +617,8 @@ void RadioModuleDetector::sendFrame(uint8_t counter, uint8_t destination, uint8_
 
     log_frame("Sending HM frame: ", sendBuffer, len);
 
+    if (_options.stats)
+        _options.stats->frameSent(counter, destination, command);
+
     _radioModuleConnector->sendFrame(sendBuffer, len);
 }
@@ -18,8 +18,11 @@
 
 #pragma once
 
+#include <mutex>
 #include "radiomoduleconnector.h"
 #include "radiomoduledetector_utils.h"
+#include "hmframe.h"
+#include "latencystats.h"
 
 typedef enum
 {
@@ -46,19 +49,54 @@ typedef enum
     DETECT_STATE_LEGACY_GET_BIDCOS_RF_ADDRESS = 61,
     DETECT_STATE_LEGACY_GET_SERIAL = 71,
 
+    DETECT_STATE_PIPELINED = 80,
+
     DETECT_STATE_FINISHED = 255,
 } detect_radio_module_state_t;
 
+typedef struct
+{
+    radio_module_type_t radioModuleType;
+    char serial[11];
+    char sgtin[25];
+    uint32_t bidCosRadioMAC;
+    uint32_t hmIPRadioMAC;
+    uint8_t firmwareVersion[3];
+} radio_module_info_t;
+
+#define MAX_PIPELINED_QUERIES 3
+
+typedef struct
+{
+    bool pipelined = false;
+    int identifyTimeout = 3000; // ms
+    int identifyRetries = 3;
+    int queryTimeout = 3000; // ms
+    int queryRetries = 0;
+    LatencyStats *stats = NULL;
+} detect_options_t;
+
+typedef struct
+{
+    detect_radio_module_state_t state;
+    uint8_t counter;
+    bool answered;
+} pending_query_t;
+
 class RadioModuleDetector : private FrameHandler
 {
 private:
     void handleFrame(unsigned char *buffer, uint16_t len);
+    void handlePipelinedFrame(HMFrame *frame);
+    void detectPipelined();
+    bool runPipelinedQueries(const detect_radio_module_state_t *states, int count);
     void sendFrame(uint8_t counter, uint8_t destination, uint8_t command, unsigned char *data, uint data_len);
 
     char _serial[11] = {0};
     uint32_t _bidCosRadioMAC = 0;
     uint32_t _hmIPRadioMAC = 0;
     char _sgtin[25] = {0};
+    uint8_t _sgtinData[12] = {0};
     uint8_t _firmwareVersion[3] = {0};
     radio_module_type_t _radioModuleType = RADIO_MODULE_NONE;
 
@@ -66,10 +104,18 @@ private:
     int _detectRetryCount;
     int _detectMsgCounter;
     SemaphoreHandle_t _detectWaitFrameDataSemaphore;
+    detect_options_t _options;
+
+    pending_query_t _pendingQueries[MAX_PIPELINED_QUERIES];
+    int _pendingQueryCount = 0;
+    int _pendingQueryOpen = 0;
+    std::mutex _pendingLock;
     RadioModuleConnector *_radioModuleConnector;
 
 public:
-    void detectRadioModule(RadioModuleConnector *radioModuleConnector);
+    void detectRadioModule(RadioModuleConnector *radioModuleConnector, detect_options_t *options);
+    bool readSGTINAndVersion(RadioModuleConnector *radioModuleConnector, detect_options_t *options);
+    void getRadioModuleInfo(radio_module_info_t *info);
     const char *getSerial();
     uint32_t getBidCosRadioMAC();
     uint32_t getHmIPRadioMAC();
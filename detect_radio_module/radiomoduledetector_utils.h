@@ -20,6 +20,7 @@
 
 #define SemaphoreHandle_t sem_t
 
+// timeout in ms, measured on CLOCK_MONOTONIC
 bool sem_wait_timeout(sem_t *sem, int timeout);
 
 #define sem_take(__sem, __timeout) sem_wait_timeout(&__sem, __timeout)
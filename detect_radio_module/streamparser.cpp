@@ -18,6 +18,7 @@
 
 #include "streamparser.h"
 #include <stdint.h>
+#include <string.h>
 
 StreamParser::StreamParser(bool decodeEscaped, std::function<void(unsigned char *buffer, uint16_t len)> processor) : _bufferPos(0), _state(NO_DATA), _isEscaped(false), _decodeEscaped(decodeEscaped), _processor(processor)
 {
@@ -35,8 +36,8 @@ void StreamParser::append(unsigned char chr)
 
     case 0xfc:
         _isEscaped = true;
-        if (_decodeEscaped)
-            return;
+        if (_decodeEscaped || _state == NO_DATA)
+            return; // Do not store anything outside of a frame
         break;
 
     default:
@@ -81,12 +82,73 @@ void StreamParser::append(unsigned char chr)
     }
 }
 
+// Returns the number of leading bytes which are neither 0xfd nor 0xfc
+static uint16_t findMarker(unsigned char *buffer, uint16_t len)
+{
+    unsigned char *pos = (unsigned char *)memchr(buffer, 0xfd, len);
+    if (pos)
+        len = pos - buffer;
+
+    pos = (unsigned char *)memchr(buffer, 0xfc, len);
+    if (pos)
+        len = pos - buffer;
+
+    return len;
+}
+
 void StreamParser::append(unsigned char *buffer, uint16_t len)
 {
-    int i;
-    for (i = 0; i < len; i++)
+    uint16_t count;
+
+    while (len > 0)
     {
-        append(buffer[i]);
+        switch (_state)
+        {
+        case NO_DATA:
+        {
+            // Everything up to the next frame prefix would be dropped anyway
+            unsigned char *pos = (unsigned char *)memchr(buffer, 0xfd, len);
+            if (!pos)
+                return;
+            len -= pos - buffer;
+            buffer = pos;
+            break;
+        }
+
+        case RECEIVE_FRAME_DATA:
+            if (_isEscaped)
+                break;
+
+            count = _frameLength - _framePos;
+            if (count > len)
+                count = len;
+            if (count > sizeof(_buffer) - _bufferPos)
+                count = sizeof(_buffer) - _bufferPos;
+
+            count = findMarker(buffer, count);
+            if (count == 0)
+                break;
+
+            memcpy(_buffer + _bufferPos, buffer, count);
+            _bufferPos += count;
+            _framePos += count;
+            buffer += count;
+            len -= count;
+
+            if (_framePos == _frameLength || _bufferPos == sizeof(_buffer))
+            {
+                _processor(_buffer, _bufferPos);
+                _state = NO_DATA;
+            }
+            continue;
+
+        default:
+            break;
+        }
+
+        // Markers and length bytes are handled by the byte-wise state machine
+        append(*buffer++);
+        len--;
     }
 }
 
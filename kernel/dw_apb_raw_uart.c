@@ -40,6 +40,7 @@
 
 #define MODULE_NAME "dw_apb_raw_uart"
 #define TX_CHUNK_SIZE 9
+#define TX_BULKTRANSFER_SIZE 64
 
 #define DW_UART_USR 0x1f   /* UART Status register */
 #define DW_UART_USR_BUSY 1 /* UART Busy */
@@ -51,6 +52,11 @@
 
 #define DW_UART_IER_PTIME 1 << 7 /* Programmable THRE Interrupt Mode Enable */
 
+#define DW_UART_TFL 0x20                                  /* Transmit FIFO level register */
+#define DW_UART_CPR 0x3d                                  /* Component parameter register */
+#define DW_UART_CPR_FIFO_STAT 1 << 10                     /* FIFO level registers available */
+#define DW_UART_CPR_FIFO_MODE(cpr) (((cpr) >> 16) & 0xff) /* FIFO depth / 16 */
+
 #define DW_UART_IIR_IID 0x0f /* nask for interrupt id */
 #define DW_UART_IIR_CTO 0x0c /* character timeout */
 
@@ -60,6 +66,7 @@ static int dw_apb_raw_uart_start_connection(struct generic_raw_uart *raw_uart);
 static void dw_apb_raw_uart_stop_connection(struct generic_raw_uart *raw_uart);
 static void dw_apb_raw_uart_stop_tx(struct generic_raw_uart *raw_uart);
 static bool dw_apb_raw_uart_isready_for_tx(struct generic_raw_uart *raw_uart);
+static int dw_apb_raw_uart_tx_fifo_free(struct generic_raw_uart *raw_uart);
 static void dw_apb_raw_uart_tx_chars(struct generic_raw_uart *raw_uart, unsigned char *chr, int index, int len);
 static void dw_apb_raw_uart_init_tx(struct generic_raw_uart *raw_uart);
 static void dw_apb_raw_uart_rx_chars(struct generic_raw_uart *raw_uart);
@@ -77,6 +84,7 @@ struct dw_apb_port_s
   void __iomem *membase; /*logical address of UART registers*/
   int regshift;
   unsigned long irq; /*interrupt number*/
+  int tx_fifo_size;  /*depth of TX FIFO, 0 if the FIFO level is not readable*/
 };
 
 static struct dw_apb_port_s *dw_apb_port;
@@ -193,9 +201,24 @@ static bool dw_apb_raw_uart_isready_for_tx(struct generic_raw_uart *raw_uart)
   return !(dw_apb_raw_uart_readb(UART_LSR) & UART_LSR_THRE); // FIFO not full
 }
 
+static int dw_apb_raw_uart_tx_fifo_free(struct generic_raw_uart *raw_uart)
+{
+  if (dw_apb_port->tx_fifo_size == 0)
+  {
+    return dw_apb_raw_uart_isready_for_tx(raw_uart) ? 1 : 0;
+  }
+
+  return max(dw_apb_port->tx_fifo_size - (int)dw_apb_raw_uart_readb(DW_UART_TFL), 0);
+}
+
 static void dw_apb_raw_uart_tx_chars(struct generic_raw_uart *raw_uart, unsigned char *chr, int index, int len)
 {
-  dw_apb_raw_uart_writeb(chr[index], UART_TX);
+  int i;
+
+  for (i = 0; i < len; i++)
+  {
+    dw_apb_raw_uart_writeb(chr[index + i], UART_TX);
+  }
 }
 
 static void dw_apb_raw_uart_init_tx(struct generic_raw_uart *raw_uart)
@@ -288,10 +311,11 @@ static struct raw_uart_driver dw_apb_raw_uart = {
     .stop_connection = dw_apb_raw_uart_stop_connection,
     .init_tx = dw_apb_raw_uart_init_tx,
     .isready_for_tx = dw_apb_raw_uart_isready_for_tx,
+    .tx_fifo_free = dw_apb_raw_uart_tx_fifo_free,
     .tx_chars = dw_apb_raw_uart_tx_chars,
     .stop_tx = dw_apb_raw_uart_stop_tx,
     .tx_chunk_size = TX_CHUNK_SIZE,
-    .tx_bulktransfer_size = 1,
+    .tx_bulktransfer_size = TX_BULKTRANSFER_SIZE,
 };
 
 static int dw_apb_raw_uart_probe(struct platform_device *pdev)
@@ -372,9 +396,14 @@ static int dw_apb_raw_uart_probe(struct platform_device *pdev)
 
   dw_apb_raw_uart_init_uart();
 
-  dev_info(dev, "Initialized dw_apb device; mapbase=0x%08lx; irq=%lu; sclk rate=%lu; pclk rate=%ld",
+  val = dw_apb_raw_uart_readb(DW_UART_CPR);
+  if (val & DW_UART_CPR_FIFO_STAT)
+    dw_apb_port->tx_fifo_size = DW_UART_CPR_FIFO_MODE(val) * 16;
+
+  dev_info(dev, "Initialized dw_apb device; mapbase=0x%08lx; irq=%lu; tx fifo size=%d; sclk rate=%lu; pclk rate=%ld",
            dw_apb_port->mapbase,
            dw_apb_port->irq,
+           dw_apb_port->tx_fifo_size,
            clk_get_rate(dw_apb_port->sclk),
            IS_ERR(dw_apb_port->pclk) ? -1 : clk_get_rate(dw_apb_port->pclk));
 
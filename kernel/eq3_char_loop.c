@@ -28,7 +28,13 @@
 #include <linux/interrupt.h>
 #include <linux/module.h>
 #include <linux/slab.h>
+#include <linux/vmalloc.h>
+#include <linux/log2.h>
+#include <linux/uio.h>
+#include <linux/splice.h>
+#include <linux/hrtimer.h>
 #include <linux/wait.h>
+#include <linux/mutex.h>
 #include <linux/poll.h>
 #include <linux/device.h>
 #include <linux/clk.h>
@@ -45,7 +51,11 @@
 
 #include "stack_protector.include"
 
+#define CREATE_TRACE_POINTS
+#include "eq3_char_loop_trace.h"
+
 #define EQ3LOOP_NUMBER_OF_CHANNELS 4
+#define EQ3LOOP_MAX_NUMBER_OF_CHANNELS 64
 #define EQ3LOOP_DRIVER_NAME "eq3loop"
 
 /* Use 'L' as magic number */
@@ -53,6 +63,7 @@
 
 #define EQ3LOOP_IOCSCREATESLAVE _IOW(EQ3LOOP_IOC_MAGIC,  1, uint32_t)
 #define EQ3LOOP_IOCGEVENTS _IOR(EQ3LOOP_IOC_MAGIC,  2, uint32_t)
+#define EQ3LOOP_IOCSFRAMEWAKEUP _IOW(EQ3LOOP_IOC_MAGIC,  3, uint32_t)
 
 #define EVENT_BIT_SLAVE_OPENED 0
 #define EVENT_BIT_SLAVE_CLOSED 1
@@ -62,6 +73,13 @@
 #define CONNECTION_TYPE_SLAVE 1
 
 #define BUFSIZE 1024  //just use buffer size power of 2. otherwise the size and index calculation dosn't work
+#define MIN_BUFSIZE 256
+#define MAX_BUFSIZE 65536
+
+#define FRAME_WAKEUP_DELAY_US 2000
+
+#define DIR_MASTER2SLAVE 0
+#define DIR_SLAVE2MASTER 1
 
 #define DUMP_READWRITE 0
 
@@ -71,16 +89,52 @@
   #define _access_ok(__type, __addr, __size) access_ok(__type, __addr, __size)
 #endif
 
+/* each counter is only updated by the side of the ring noted */
+struct eq3loop_stats
+{
+	int dir;                                           //DIR_*, for tracing
+	unsigned long bytes;                               //producer
+	unsigned long writes;                              //producer
+	unsigned long full;                                //producer, no space left in the ring
+	unsigned long write_eagain;                        //producer
+	unsigned long wakeups;                             //producer
+	unsigned long timer_wakeups;                       //frame wakeup timer
+	int max_fill;                                      //producer
+	unsigned long read_bytes;                          //consumer
+	unsigned long reads;                               //consumer
+	unsigned long read_eagain;                         //consumer
+};
+
+struct eq3loop_frame_wakeup
+{
+	struct hrtimer timer;                              //deadline for waking the reader on an incomplete frame
+	wait_queue_head_t *wq;
+	struct eq3loop_stats *stats;
+	int decoded;                                       //decoded bytes of the current frame, 0 outside of a frame
+	int expected;
+	int escaped;
+	unsigned char hdr[3];
+};
+
 struct eq3loop_channel_data
 {
 	struct circ_buf master2slave_buf;
 	struct circ_buf slave2master_buf;
-	unsigned char _master2slave_buf[BUFSIZE];
-	unsigned char _slave2master_buf[BUFSIZE];
+	int buf_size;                                      //size of each ring, power of 2
 	
 	wait_queue_head_t master2slaveq;
 	wait_queue_head_t slave2masterq;
-	struct semaphore sem;                              //semaphore for accessing this struct. 
+	struct eq3loop_frame_wakeup master2slave_wakeup;
+	struct eq3loop_frame_wakeup slave2master_wakeup;
+	int frame_wakeup;                                  //wake readers on complete HM frames only
+	ktime_t frame_wakeup_delay;
+	struct eq3loop_stats master2slave_stats;
+	struct eq3loop_stats slave2master_stats;
+	struct semaphore sem;                              //semaphore for open/close/ioctl, the data path is lock-free
+	struct mutex master2slave_read_lock;               //serializes readers of master2slave_buf sharing the slave file
+	struct mutex master2slave_write_lock;              //serializes writers of master2slave_buf sharing the master file
+	struct mutex slave2master_read_lock;
+	struct mutex slave2master_write_lock;
 	volatile long unsigned int pending_events;
 	volatile long unsigned int slave_open_count;
 	volatile long unsigned int created;
@@ -93,7 +147,7 @@ struct eq3loop_control_data {
 	dev_t devnode;
 	struct cdev cdev;
 	struct class * class;
-	struct eq3loop_channel_data channels[EQ3LOOP_NUMBER_OF_CHANNELS];
+	struct eq3loop_channel_data *channels;
 	struct semaphore sem;                              //semaphore for accessing this struct. 
 };
 
@@ -101,8 +155,8 @@ struct eq3loop_connection_data
 {
 	int connection_type;
 	struct eq3loop_channel_data* channel;
-	ssize_t (*read) (struct eq3loop_channel_data *, struct file *, char __user *, size_t, loff_t *);
-	ssize_t (*write) (struct eq3loop_channel_data *, struct file *, const char __user *, size_t, loff_t *);    
+	ssize_t (*read) (struct eq3loop_channel_data *, struct file *, struct iov_iter *);
+	ssize_t (*write) (struct eq3loop_channel_data *, struct file *, struct iov_iter *);
 	long (*ioctl) (struct eq3loop_channel_data *, struct file *, unsigned int cmd, unsigned long arg);
 	int (*close) (struct eq3loop_channel_data *, struct file *);
 	unsigned int (*poll) (struct eq3loop_channel_data *, struct file*, poll_table* wait);
@@ -110,76 +164,248 @@ struct eq3loop_connection_data
 
 static struct eq3loop_control_data* control_data;
 
-static ssize_t eq3loop_read_slave(struct eq3loop_channel_data* channel, struct file *filp, char *buf, size_t count, loff_t *offset)
+static int number_of_channels = EQ3LOOP_NUMBER_OF_CHANNELS;
+static int buf_size = BUFSIZE;
+static bool frame_wakeup = false;
+static unsigned int frame_wakeup_delay_us = FRAME_WAKEUP_DELAY_US;
+
+/*
+* Each direction is a single producer / single consumer ring: the master connection is the only
+* writer of master2slave_buf and the (exclusive) slave connection its only reader, and vice versa.
+* The producer owns head, the consumer owns tail, and both are published with release/acquire
+* ordering, so producer and consumer don't lock each other out (see
+* Documentation/core-api/circular-buffers.rst). Several threads may share one file though, so each
+* end of a ring has a mutex held across the copy and the index update, which is uncontended in the
+* normal case.
+*/
+static inline int eq3loop_ring_cnt(struct eq3loop_channel_data* channel, struct circ_buf *ring)
 {
-	ssize_t ret = 0;
-	int count_to_end,tail;
-	if (down_interruptible(&channel->sem)){
-		return -ERESTARTSYS;
-	}
+	return CIRC_CNT( smp_load_acquire(&ring->head), READ_ONCE(ring->tail), channel->buf_size );
+}
 
-	
-	if( !channel->created )
+static inline int eq3loop_ring_space(struct eq3loop_channel_data* channel, struct circ_buf *ring)
+{
+	return CIRC_SPACE( READ_ONCE(ring->head), smp_load_acquire(&ring->tail), channel->buf_size );
+}
+
+static ssize_t eq3loop_ring_read(struct eq3loop_channel_data* channel, struct circ_buf *ring, struct eq3loop_stats *stats, struct iov_iter *to, const char *caller)
+{
+	int head, tail, count, count_to_end;
+	size_t copied;
+
+	head = smp_load_acquire(&ring->head);
+	tail = ring->tail;
+	count = min_t(size_t, iov_iter_count(to), CIRC_CNT( head, tail, channel->buf_size));
+	count_to_end = min(count, CIRC_CNT_TO_END( head, tail, channel->buf_size));
+
+	copied = copy_to_iter(ring->buf + tail, count_to_end, to);
+	if( copied == count_to_end && count > count_to_end )
 	{
-		ret = -ENODEV;
-		goto out;
+		copied += copy_to_iter(ring->buf, count - count_to_end, to);
 	}
-	while( channel->created && !CIRC_CNT( channel->master2slave_buf.head, channel->master2slave_buf.tail, BUFSIZE)) { /* nothing to read */
-		up(&channel->sem); /* release the lock */
-		if (filp->f_flags & O_NONBLOCK)	{
-			return -EAGAIN;
-		}
-		if (wait_event_interruptible(channel->master2slaveq, (!channel->created) || CIRC_CNT( channel->master2slave_buf.head, channel->master2slave_buf.tail, BUFSIZE))){
-			return -ERESTARTSYS; /* signal: tell the fs layer to handle it */
-		}
-		/* otherwise loop, but first reacquire the lock */
-		if (down_interruptible(&channel->sem)){
-			return -ERESTARTSYS;
+	if( !copied && count )
+	{
+		return -EFAULT;
+	}
+
+	#if DUMP_READWRITE
+	{
+		int i;
+		printk( KERN_INFO EQ3LOOP_DRIVER_NAME ": %s() %s:", caller, channel->name );
+		for( i=0; i<copied; i++ )
+		{
+			printk( " %02X", ring->buf[(tail + i) & (channel->buf_size - 1)] );
 		}
 	}
-	
-	if( !channel->created )
+	#endif
+
+	/* the data must be copied out before the producer may reuse the space */
+	smp_store_release(&ring->tail, (tail + copied) & (channel->buf_size - 1));
+
+	trace_eq3loop_read( channel->name, stats->dir, stats->read_bytes, copied, CIRC_CNT( head, tail + copied, channel->buf_size ) );
+	WRITE_ONCE(stats->read_bytes, stats->read_bytes + copied);
+	return copied;
+}
+
+static ssize_t eq3loop_ring_write(struct eq3loop_channel_data* channel, struct circ_buf *ring, struct eq3loop_stats *stats, struct iov_iter *from, const char *caller)
+{
+	int head, tail, count, count_to_end;
+	size_t copied;
+
+	head = ring->head;
+	tail = smp_load_acquire(&ring->tail);
+	count = min_t(size_t, iov_iter_count(from), CIRC_SPACE( head, tail, channel->buf_size));
+	count_to_end = min(count, CIRC_SPACE_TO_END( head, tail, channel->buf_size));
+
+	copied = copy_from_iter(ring->buf + head, count_to_end, from);
+	if( copied == count_to_end && count > count_to_end )
 	{
-		ret = -ENODEV;
-		goto out;
+		copied += copy_from_iter(ring->buf, count - count_to_end, from);
 	}
-	tail = channel->master2slave_buf.tail;
-	/* ok, data is there, return something */
-	count = min((int)count, CIRC_CNT( channel->master2slave_buf.head, tail, BUFSIZE));
-	count_to_end = min((int)count,CIRC_CNT_TO_END(channel->master2slave_buf.head,tail,BUFSIZE));
-	
+	if( !copied && count )
+	{
+		return -EFAULT;
+	}
+
 	#if DUMP_READWRITE
 	{
 		int i;
-		printk( KERN_INFO EQ3LOOP_DRIVER_NAME ": eq3loop_read_slave() %s:", channel->name );
-		for( i=0; i<count; i++ )
+		printk( KERN_INFO EQ3LOOP_DRIVER_NAME ": %s() %s:", caller, channel->name );
+		for( i=0; i<copied; i++ )
 		{
-			printk( " %02X", channel->master2slave_buf.buf[(tail + i) & (BUFSIZE - 1)] );
+			printk( " %02X", ring->buf[(head + i) & (channel->buf_size - 1)] );
 		}
 	}
 	#endif
-	
-	
-	if (copy_to_user(buf, channel->master2slave_buf.buf + tail, count_to_end)) {
-		ret = -EFAULT;
-		goto out;
+
+	/* the data must be visible before the consumer sees the new head */
+	smp_store_release(&ring->head, (head + copied) & (channel->buf_size - 1));
+
+	count = CIRC_CNT( head + copied, tail, channel->buf_size );
+	trace_eq3loop_write( channel->name, stats->dir, stats->bytes, copied, count );
+	WRITE_ONCE(stats->bytes, stats->bytes + copied);
+	if( count > stats->max_fill )
+	{
+		WRITE_ONCE(stats->max_fill, count);
 	}
-	tail = (tail + count_to_end) & (BUFSIZE - 1);
+	return copied;
+}
+
+/*
+* Tracks the HM frames (0xFD, 2 byte length, payload, 2 byte CRC, 0xFC escapes) of count bytes just
+* written at head into ring. Returns true, if at least one frame got completed.
+*/
+static bool eq3loop_frame_complete(struct eq3loop_channel_data* channel, struct circ_buf *ring, struct eq3loop_frame_wakeup *wakeup, int head, int count)
+{
+	bool complete = false;
+	unsigned char cur;
+	int i;
 
-	if (copy_to_user(buf + count_to_end, channel->master2slave_buf.buf + tail, count - count_to_end)) {
-		ret = -EFAULT;
+	for( i = 0; i < count; i++ )
+	{
+		cur = ring->buf[(head + i) & (channel->buf_size - 1)];
+		if( cur == 0xfd )
+		{
+			wakeup->decoded = 1;
+			wakeup->expected = 0;
+			wakeup->escaped = 0;
+			continue;
+		}
+		if( !wakeup->decoded )
+		{
+			continue;
+		}
+		if( cur == 0xfc )
+		{
+			wakeup->escaped = 1;
+			continue;
+		}
+		if( wakeup->escaped )
+		{
+			cur |= 0x80;
+			wakeup->escaped = 0;
+		}
+
+		if( wakeup->decoded < sizeof(wakeup->hdr) )
+		{
+			wakeup->hdr[wakeup->decoded] = cur;
+		}
+		if( ++wakeup->decoded == sizeof(wakeup->hdr) )
+		{
+			wakeup->expected = ((wakeup->hdr[1] << 8) | wakeup->hdr[2]) + 5;
+		}
+		if( wakeup->decoded == wakeup->expected )
+		{
+			wakeup->decoded = 0;
+			complete = true;
+		}
+	}
+
+	return complete;
+}
+
+/*
+* Called by the producer after count bytes were written at head. Without frame wakeup the reader
+* is woken up immediately. Otherwise only a completed frame or a half full ring wakes it, any
+* other data waits for the frame wakeup deadline, so byte-dribbling writers don't cause a context
+* switch per fragment.
+*/
+static void eq3loop_wake_reader(struct eq3loop_channel_data* channel, struct circ_buf *ring, struct eq3loop_frame_wakeup *wakeup, int head, int count)
+{
+	if( !READ_ONCE(channel->frame_wakeup) ||
+		eq3loop_frame_complete( channel, ring, wakeup, head, count ) ||
+		eq3loop_ring_cnt( channel, ring ) >= channel->buf_size / 2 )
+	{
+		hrtimer_try_to_cancel( &wakeup->timer );
+		WRITE_ONCE(wakeup->stats->wakeups, wakeup->stats->wakeups + 1);
+		wake_up_interruptible( wakeup->wq );
+		return;
+	}
+
+	if( !hrtimer_is_queued( &wakeup->timer ) )
+	{
+		hrtimer_start( &wakeup->timer, channel->frame_wakeup_delay, HRTIMER_MODE_REL );
+	}
+}
+
+static enum hrtimer_restart eq3loop_frame_wakeup_timer_fn(struct hrtimer *timer)
+{
+	struct eq3loop_frame_wakeup *wakeup = container_of(timer, struct eq3loop_frame_wakeup, timer);
+
+	WRITE_ONCE(wakeup->stats->timer_wakeups, wakeup->stats->timer_wakeups + 1);
+	wake_up_interruptible( wakeup->wq );
+	return HRTIMER_NORESTART;
+}
+
+static void eq3loop_init_frame_wakeup(struct eq3loop_frame_wakeup *wakeup, wait_queue_head_t *wq, struct eq3loop_stats *stats)
+{
+	memset( wakeup, 0, sizeof(*wakeup) );
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+	hrtimer_setup( &wakeup->timer, eq3loop_frame_wakeup_timer_fn, CLOCK_MONOTONIC, HRTIMER_MODE_REL );
+#else
+	hrtimer_init( &wakeup->timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL );
+	wakeup->timer.function = eq3loop_frame_wakeup_timer_fn;
+#endif
+	wakeup->wq = wq;
+	wakeup->stats = stats;
+}
+
+static ssize_t eq3loop_read_slave(struct eq3loop_channel_data* channel, struct file *filp, struct iov_iter *to)
+{
+	ssize_t ret = 0;
+
+	if( !channel->created )
+	{
+		ret = -ENODEV;
 		goto out;
 	}
-	tail = (tail + (count - count_to_end)) & (BUFSIZE - 1);
-	smp_mb();
-	channel->master2slave_buf.tail = tail;
-	ret = count;
+	do {
+		while( channel->created && !eq3loop_ring_cnt(channel, &channel->master2slave_buf) ) { /* nothing to read */
+			if (filp->f_flags & O_NONBLOCK)	{
+				WRITE_ONCE(channel->master2slave_stats.read_eagain, channel->master2slave_stats.read_eagain + 1);
+				return -EAGAIN;
+			}
+			if (wait_event_interruptible(channel->master2slaveq, (!channel->created) || eq3loop_ring_cnt(channel, &channel->master2slave_buf))){
+				return -ERESTARTSYS; /* signal: tell the fs layer to handle it */
+			}
+		}
+		
+		if( !channel->created )
+		{
+			ret = -ENODEV;
+			goto out;
+		}
+		/* ok, data is there, return something */
+		if (mutex_lock_interruptible(&channel->master2slave_read_lock))
+			return -ERESTARTSYS;
+		ret = eq3loop_ring_read( channel, &channel->master2slave_buf, &channel->master2slave_stats, to, __func__ );
+		mutex_unlock(&channel->master2slave_read_lock);
+	} while( !ret && iov_iter_count(to) ); /* another reader of this file took the data */
 	
 out:
-	up (&channel->sem);
-
 	if( ret > 0 )
 	{
+		WRITE_ONCE(channel->master2slave_stats.reads, channel->master2slave_stats.reads + 1);
 		wake_up_interruptible( &channel->master2slaveq );
 	}
 	else
@@ -189,232 +415,179 @@ out:
 	return ret;
 }
 
-static ssize_t eq3loop_read_master(struct eq3loop_channel_data* channel, struct file *filp, char *buf, size_t count, loff_t *offset)
+static ssize_t eq3loop_read_master(struct eq3loop_channel_data* channel, struct file *filp, struct iov_iter *to)
 {
 	ssize_t ret = 0;
-	int count_to_end,tail;
-	if (down_interruptible(&channel->sem))
-		return -ERESTARTSYS;
 	
-	while( channel->slave_open_count && (!CIRC_CNT( channel->slave2master_buf.head, channel->slave2master_buf.tail, BUFSIZE))) { /* slave open but nothing to read */
-		up(&channel->sem); /* release the lock */
-		if (filp->f_flags & O_NONBLOCK)
-			return -EAGAIN;
-		if (wait_event_interruptible(channel->slave2masterq, (!channel->slave_open_count) || CIRC_CNT( channel->slave2master_buf.head, channel->slave2master_buf.tail, BUFSIZE)))
-			return -ERESTARTSYS; /* signal: tell the fs layer to handle it */
-		/* otherwise loop, but first reacquire the lock */
-		if (down_interruptible(&channel->sem))
-			return -ERESTARTSYS;
-	}
-	if( channel->slave_open_count )
-	{
-		tail = channel->slave2master_buf.tail;
-		/* ok, data is there, return something */
-		count = min((int)count, CIRC_CNT( channel->slave2master_buf.head, tail, BUFSIZE));
-		count_to_end = min((int)count,CIRC_CNT_TO_END(channel->slave2master_buf.head, tail, BUFSIZE));
-		
-		#if DUMP_READWRITE
-		{
-			int i;
-			printk( KERN_INFO EQ3LOOP_DRIVER_NAME ": eq3loop_read_master() %s:", channel->name );
-			for( i=0; i<count; i++ )
+	do {
+		while( channel->slave_open_count && !eq3loop_ring_cnt(channel, &channel->slave2master_buf) ) { /* slave open but nothing to read */
+			if (filp->f_flags & O_NONBLOCK)
 			{
-				printk( " %02X", channel->slave2master_buf.buf[(tail + i) & (BUFSIZE - 1)] );
+				WRITE_ONCE(channel->slave2master_stats.read_eagain, channel->slave2master_stats.read_eagain + 1);
+				return -EAGAIN;
 			}
+			if (wait_event_interruptible(channel->slave2masterq, (!channel->slave_open_count) || eq3loop_ring_cnt(channel, &channel->slave2master_buf)))
+				return -ERESTARTSYS; /* signal: tell the fs layer to handle it */
 		}
-		#endif
-		
-		
-		if (copy_to_user(buf, channel->slave2master_buf.buf + tail, count_to_end)) {
-			ret = -EFAULT;
-			goto out;
-		}
-		tail = (tail + count_to_end) & (BUFSIZE - 1);
-		if (copy_to_user(buf + count_to_end, channel->slave2master_buf.buf + tail, count - count_to_end)) {
-			ret = -EFAULT;
-			goto out;
+		if( !channel->slave_open_count )
+		{
+			break;
 		}
-		tail = (tail + (count - count_to_end)) & (BUFSIZE - 1);
-		smp_mb();
-		channel->slave2master_buf.tail = tail;
-		ret = count;
-	}
-	
-	
-out:
-	up (&channel->sem);
+		/* ok, data is there, return something */
+		if (mutex_lock_interruptible(&channel->slave2master_read_lock))
+			return -ERESTARTSYS;
+		ret = eq3loop_ring_read( channel, &channel->slave2master_buf, &channel->slave2master_stats, to, __func__ );
+		mutex_unlock(&channel->slave2master_read_lock);
+	} while( !ret && iov_iter_count(to) ); /* another reader of this file took the data */
 	
 	if( ret > 0 )
 	{
+		WRITE_ONCE(channel->slave2master_stats.reads, channel->slave2master_stats.reads + 1);
 		wake_up_interruptible( &channel->slave2masterq );
 	}
 
 	return ret;
 }
 
-static ssize_t eq3loop_read(struct file *filp, char *buf, size_t count, loff_t *offset)
+static ssize_t eq3loop_read_iter(struct kiocb *iocb, struct iov_iter *to)
 {
+	struct file *filp = iocb->ki_filp;
 	struct eq3loop_connection_data *conn = filp->private_data;
 	if( conn && conn->read )
 	{
-		return conn->read( conn->channel, filp, buf, count, offset );
+		return conn->read( conn->channel, filp, to );
 	}
 	return -EFAULT;
 }
 
-static ssize_t eq3loop_write_slave(struct eq3loop_channel_data* channel, struct file *filp, const char *buf, size_t count, loff_t *offset)
+/*
+* Writes are not all-or-nothing: whatever fits into the ring is queued and the reader woken up.
+* A blocking writer then waits for the reader to make room for the rest, a non-blocking writer
+* returns the short count (or -EAGAIN if nothing fit at all).
+*/
+static ssize_t eq3loop_write_slave(struct eq3loop_channel_data* channel, struct file *filp, struct iov_iter *from)
 {
-	int head;
 	ssize_t ret=0;
-        ssize_t count_to_end;
-	if (down_interruptible(&channel->sem))
-		return -ERESTARTSYS;
+	size_t written=0;
+	int head;
 
-	while(!CIRC_SPACE( channel->slave2master_buf.head, channel->slave2master_buf.tail, BUFSIZE)) { /* no space to write */
-		up(&channel->sem); /* release the lock */
-		if (filp->f_flags & O_NONBLOCK)
-			return -EAGAIN;
-		if (wait_event_interruptible(channel->slave2masterq, (!channel->created) || CIRC_SPACE( channel->slave2master_buf.head, channel->slave2master_buf.tail, BUFSIZE)))
-			return -ERESTARTSYS; /* signal: tell the fs layer to handle it */
-		/* otherwise loop, but first reacquire the lock */
-		if (down_interruptible(&channel->sem))
-			return -ERESTARTSYS;
-	}
-	
-	if( !channel->created )
-	{
-		ret = -ENODEV;
-		goto out;
-	}
-	head = channel->slave2master_buf.head;
-	if(CIRC_SPACE( head, channel->slave2master_buf.tail, BUFSIZE) < count)
+	while( iov_iter_count(from) )
 	{
-		ret=-EFAULT;
-		goto out;
-	}
-	
-	/* ok, space is free, write something */
-	count_to_end = min((int)count, CIRC_SPACE_TO_END( head, channel->slave2master_buf.tail, BUFSIZE));
-	
-	if(copy_from_user(channel->slave2master_buf.buf + head, buf, count_to_end)){
-		ret=-EFAULT;
-		goto out;
-	}
-    head = (head + count_to_end) & (BUFSIZE - 1);
+		if( !channel->created )
+		{
+			ret = -ENODEV;
+			break;
+		}
+		if( !eq3loop_ring_space(channel, &channel->slave2master_buf) ) { /* no space to write */
+			WRITE_ONCE(channel->slave2master_stats.full, channel->slave2master_stats.full + 1);
+			if (filp->f_flags & O_NONBLOCK)
+			{
+				WRITE_ONCE(channel->slave2master_stats.write_eagain, channel->slave2master_stats.write_eagain + 1);
+				ret = -EAGAIN;
+				break;
+			}
+			if (wait_event_interruptible(channel->slave2masterq, (!channel->created) || eq3loop_ring_space(channel, &channel->slave2master_buf)))
+			{
+				ret = -ERESTARTSYS; /* signal: tell the fs layer to handle it */
+				break;
+			}
+			continue;
+		}
 
-	if(copy_from_user(channel->slave2master_buf.buf + head, buf+count_to_end, count - count_to_end)){
-		ret=-EFAULT;
-		goto out;
-	}
- 	head = (head + (count - count_to_end)) & (BUFSIZE - 1);
-	#if DUMP_READWRITE
-	{
-		int i;
-        if(head < channel->slave2master_buf.head)
-        {
-        	printk( KERN_INFO EQ3LOOP_DRIVER_NAME ": eq3loop_write_slave() reach end of circular buffer" );
-        }
-		printk( KERN_INFO EQ3LOOP_DRIVER_NAME ": eq3loop_write_slave() %s:", channel->name );
-		for( i=0; i<count; i++ )
+		/* ok, space is free, write something */
+		if (mutex_lock_interruptible(&channel->slave2master_write_lock))
+		{
+			ret = -ERESTARTSYS;
+			break;
+		}
+		head = channel->slave2master_buf.head;
+		ret = eq3loop_ring_write( channel, &channel->slave2master_buf, &channel->slave2master_stats, from, __func__ );
+		if( ret > 0 )
+		{
+			eq3loop_wake_reader( channel, &channel->slave2master_buf, &channel->slave2master_wakeup, head, ret );
+		}
+		mutex_unlock(&channel->slave2master_write_lock);
+		if( ret < 0 )
 		{
-			printk( " %02X", channel->slave2master_buf.buf[(channel->slave2master_buf.head + i)& (BUFSIZE - 1)] );
+			break;
 		}
+		written += ret;
 	}
-	#endif
-	
-	
-	smp_mb();
-	channel->slave2master_buf.head = head;
-	
-	ret = count;
-	
-out:
-	up (&channel->sem);
 
-	if( ret > 0 )
+	if( written )
 	{
-		wake_up_interruptible( &channel->slave2masterq );
+		WRITE_ONCE(channel->slave2master_stats.writes, channel->slave2master_stats.writes + 1);
 	}
-	
-	return ret;
+
+	return written ? written : ret;
 }
 
-static ssize_t eq3loop_write_master(struct eq3loop_channel_data* channel, struct file *filp, const char *buf, size_t count, loff_t *offset)
+static ssize_t eq3loop_write_master(struct eq3loop_channel_data* channel, struct file *filp, struct iov_iter *from)
 {
 	ssize_t ret=0;
+	size_t written=0;
 	int head;
-	ssize_t count_to_end;
-	if (down_interruptible(&channel->sem))
-		return -ERESTARTSYS;
 
-	while(!CIRC_SPACE( channel->master2slave_buf.head, channel->master2slave_buf.tail, BUFSIZE)) { /* no space to write */
-		up(&channel->sem); /* release the lock */
-		if (filp->f_flags & O_NONBLOCK)
-			return -EAGAIN;
-		if (wait_event_interruptible(channel->master2slaveq, (!channel->slave_open_count) || CIRC_SPACE( channel->master2slave_buf.head, channel->master2slave_buf.tail, BUFSIZE)))
-			return -ERESTARTSYS; /* signal: tell the fs layer to handle it */
-		/* otherwise loop, but first reacquire the lock */
-		if (down_interruptible(&channel->sem))
-			return -ERESTARTSYS;
-	}
-	head = channel->master2slave_buf.head;
-	if(CIRC_SPACE( head, channel->master2slave_buf.tail, BUFSIZE) < count)
+	while( iov_iter_count(from) )
 	{
-		ret=-EFAULT;
-		count_to_end = CIRC_SPACE( head, channel->master2slave_buf.tail, BUFSIZE);
-		printk( KERN_ERR EQ3LOOP_DRIVER_NAME ": eq3loop_write_master() %s: not enough space in buffers. free space = %zu, required space = %zu", channel->name,count_to_end,count );
-		goto out;
-	}
-	/* ok, space is free, write something */
-	count_to_end = min((int)count, CIRC_SPACE_TO_END( head, channel->master2slave_buf.tail, BUFSIZE));
+		if( !eq3loop_ring_space(channel, &channel->master2slave_buf) ) { /* no space to write */
+			WRITE_ONCE(channel->master2slave_stats.full, channel->master2slave_stats.full + 1);
+			if (filp->f_flags & O_NONBLOCK)
+			{
+				WRITE_ONCE(channel->master2slave_stats.write_eagain, channel->master2slave_stats.write_eagain + 1);
+				ret = -EAGAIN;
+				break;
+			}
+			/* opening the slave discards stale data and wakes us up as well */
+			if (wait_event_interruptible(channel->master2slaveq, eq3loop_ring_space(channel, &channel->master2slave_buf)))
+			{
+				ret = -ERESTARTSYS; /* signal: tell the fs layer to handle it */
+				break;
+			}
+			continue;
+		}
 
-	if(copy_from_user(channel->master2slave_buf.buf + head, buf, count_to_end)){
-		ret=-EFAULT;
-		printk( KERN_ERR EQ3LOOP_DRIVER_NAME ": eq3loop_write_master() %s: unable to copy buffer",channel->name );
-		goto out;
-	}
-	head = (head + count_to_end) & (BUFSIZE - 1);
-	if(copy_from_user(channel->master2slave_buf.buf + head, buf+count_to_end,count - count_to_end)){
-		ret=-EFAULT;
-		printk( KERN_ERR EQ3LOOP_DRIVER_NAME ": eq3loop_write_master() %s: unable to copy buffer",channel->name );
-		goto out;
-	}
-	head = (head + (count - count_to_end)) & (BUFSIZE - 1);
-	#if DUMP_READWRITE
-	{
-		int i;
-		printk( KERN_INFO EQ3LOOP_DRIVER_NAME ": eq3loop_write_master() %s:", channel->name );
-		for( i=0; i<count; i++ )
+		/* ok, space is free, write something */
+		if (mutex_lock_interruptible(&channel->master2slave_write_lock))
+		{
+			ret = -ERESTARTSYS;
+			break;
+		}
+		head = channel->master2slave_buf.head;
+		ret = eq3loop_ring_write( channel, &channel->master2slave_buf, &channel->master2slave_stats, from, __func__ );
+		if( ret > 0 )
 		{
-			printk( " %02X", channel->master2slave_buf.buf[(channel->master2slave_buf.head + i)&(BUFSIZE - 1)] );
+			//send a signal to reading procces
+			eq3loop_wake_reader( channel, &channel->master2slave_buf, &channel->master2slave_wakeup, head, ret );
 		}
+		mutex_unlock(&channel->master2slave_write_lock);
+		if( ret < 0 )
+		{
+			printk( KERN_ERR EQ3LOOP_DRIVER_NAME ": eq3loop_write_master() %s: unable to copy buffer",channel->name );
+			break;
+		}
+		written += ret;
 	}
-	#endif
-	smp_mb();
-	channel->master2slave_buf.head = head;
-	ret = count;
 
-out:
-	up (&channel->sem);
-	if(ret < 0)
+	if( written )
 	{
-		printk( KERN_INFO EQ3LOOP_DRIVER_NAME ": eq3loop_write_master() return error: %zd", ret);
+		WRITE_ONCE(channel->master2slave_stats.writes, channel->master2slave_stats.writes + 1);
 	}
-	if( ret > 0 || CIRC_CNT(channel->master2slave_buf.head,channel->master2slave_buf.tail,BUFSIZE) )
+	else if( ret < 0 && ret != -EAGAIN && ret != -ERESTARTSYS )
 	{
-		//send a signal to reading procces if return is ok or data in the buffer
-		wake_up_interruptible( &channel->master2slaveq );
+		printk( KERN_INFO EQ3LOOP_DRIVER_NAME ": eq3loop_write_master() return error: %zd", ret);
 	}
 	
-	return ret;
+	return written ? written : ret;
 }
 
-static ssize_t eq3loop_write(struct file *filp, const char *buf, size_t count, loff_t *offset)
+static ssize_t eq3loop_write_iter(struct kiocb *iocb, struct iov_iter *from)
 {
+	struct file *filp = iocb->ki_filp;
 	struct eq3loop_connection_data *conn = filp->private_data;
 	if( conn && conn->write )
 	{
-		return conn->write( conn->channel, filp, buf, count, offset );
+		return conn->write( conn->channel, filp, from );
 	}
 	return -EFAULT;
 }
@@ -492,6 +665,19 @@ static long eq3loop_ioctl_master(struct eq3loop_channel_data* channel, struct fi
 			smp_mb();
 		}
 		break;
+	case EQ3LOOP_IOCSFRAMEWAKEUP:
+		ret = __get_user(temp, (uint32_t *)arg);
+		if( !ret )
+		{
+			WRITE_ONCE(channel->frame_wakeup, temp ? 1 : 0);
+			if( !temp )
+			{
+				/* don't leave data behind waiting for a deadline */
+				wake_up_interruptible( &channel->master2slaveq );
+				wake_up_interruptible( &channel->slave2masterq );
+			}
+		}
+		break;
 	default:
 		return -ENOTTY;
 	}
@@ -580,11 +766,11 @@ static long eq3loop_ioctl_slave(struct eq3loop_channel_data* channel, struct fil
 	}
 #endif
 	case TIOCINQ:
-		temp = CIRC_CNT( channel->master2slave_buf.head, channel->master2slave_buf.tail, BUFSIZE);
+		temp = eq3loop_ring_cnt(channel, &channel->master2slave_buf);
 		ret = __put_user( temp, (int*)arg );
 		break;
 	case TIOCOUTQ:
-		temp = CIRC_CNT( channel->slave2master_buf.head, channel->slave2master_buf.tail, BUFSIZE);
+		temp = eq3loop_ring_cnt(channel, &channel->slave2master_buf);
 		ret = __put_user( temp, (int*)arg );
 		break;
 	case TIOCEXCL:
@@ -645,6 +831,20 @@ static long eq3loop_ioctl(struct file *filp, unsigned int cmd, unsigned long arg
 }
 
 
+static void eq3loop_cancel_frame_wakeups(struct eq3loop_channel_data* channel)
+{
+	hrtimer_cancel( &channel->master2slave_wakeup.timer );
+	hrtimer_cancel( &channel->slave2master_wakeup.timer );
+}
+
+static void eq3loop_free_buffers(struct eq3loop_channel_data* channel)
+{
+	vfree( channel->master2slave_buf.buf );
+	vfree( channel->slave2master_buf.buf );
+	channel->master2slave_buf.buf = NULL;
+	channel->slave2master_buf.buf = NULL;
+}
+
 static int eq3loop_close_slave(struct eq3loop_channel_data* channel, struct file *filp)
 {
 	int ret = 0;
@@ -668,6 +868,8 @@ static int eq3loop_close_slave(struct eq3loop_channel_data* channel, struct file
 	{
 		printk( KERN_INFO EQ3LOOP_DRIVER_NAME ": eq3loop_close_slave() %s destroy device\n", channel->name );
 		device_destroy(control_data->class, channel->devnode);
+		eq3loop_cancel_frame_wakeups( channel );
+		eq3loop_free_buffers( channel );
 	}
 	
 	up( &channel->sem );
@@ -701,11 +903,14 @@ static int eq3loop_close_master(struct eq3loop_channel_data* channel, struct fil
 	{
 		printk( KERN_INFO EQ3LOOP_DRIVER_NAME ": eq3loop_close_master() %s destroy device\n", channel->name );
 		device_destroy(control_data->class, channel->devnode);
+		eq3loop_cancel_frame_wakeups( channel );
+		eq3loop_free_buffers( channel );
 	}
 	
 out:
 	up( &channel->sem );
 	wake_up_interruptible( &channel->master2slaveq );
+	wake_up_interruptible( &channel->slave2masterq );
 	return ret;
 }
 
@@ -740,17 +945,14 @@ static unsigned int eq3loop_poll_master(struct eq3loop_channel_data* channel, st
 		poll_wait(filp, &channel->master2slaveq, wait);
 	}
 	
-	if (down_interruptible(&channel->sem))
-	return -ERESTARTSYS;    
-	
 	if( channel->slave_open_count )
 	{
-		if( CIRC_SPACE( channel->master2slave_buf.head, channel->master2slave_buf.tail, BUFSIZE) )
+		if( eq3loop_ring_space(channel, &channel->master2slave_buf) )
 		{
 			mask |= POLLOUT | POLLWRNORM;
 		}
 		
-		if( CIRC_CNT( channel->slave2master_buf.head, channel->slave2master_buf.tail, BUFSIZE) )
+		if( eq3loop_ring_cnt(channel, &channel->slave2master_buf) )
 		{
 			mask |= POLLIN | POLLRDNORM;
 		}
@@ -760,10 +962,6 @@ static unsigned int eq3loop_poll_master(struct eq3loop_channel_data* channel, st
 	{
 		mask |= POLLPRI;
 	}
-	
-	
-	
-	up( &channel->sem );
 
 	return mask;
 }
@@ -782,15 +980,12 @@ static unsigned int eq3loop_poll_slave(struct eq3loop_channel_data* channel, str
 		poll_wait(filp, &channel->slave2masterq, wait);
 	}
 	
-	if (down_interruptible(&channel->sem))
-	return -ERESTARTSYS;    
-	
-	if( CIRC_CNT( channel->master2slave_buf.head, channel->master2slave_buf.tail, BUFSIZE) )
+	if( eq3loop_ring_cnt(channel, &channel->master2slave_buf) )
 	{
 		mask |= POLLIN | POLLRDNORM;
 	}
 	
-	if( CIRC_SPACE( channel->slave2master_buf.head, channel->slave2master_buf.tail, BUFSIZE) )
+	if( eq3loop_ring_space(channel, &channel->slave2master_buf) )
 	{
 		mask |= POLLOUT | POLLWRNORM;
 	}
@@ -800,8 +995,6 @@ static unsigned int eq3loop_poll_slave(struct eq3loop_channel_data* channel, str
 		mask |= POLLERR;
 	}
 	
-	up( &channel->sem );
-	
 	return mask;
 }
 
@@ -821,6 +1014,53 @@ static unsigned int eq3loop_poll(struct file* filp, poll_table* wait)
 }
 
 
+#define EQ3LOOP_STAT_ATTR(_dir, _field) \
+static ssize_t _dir##_##_field##_show(struct device *dev, struct device_attribute *attr, char *page) \
+{ \
+	struct eq3loop_channel_data *channel = dev_get_drvdata(dev); \
+	return sprintf(page, "%lu\n", (unsigned long)READ_ONCE(channel->_dir##_stats._field)); \
+} \
+static struct device_attribute dev_attr_##_dir##_##_field = __ATTR(_field, S_IRUGO, _dir##_##_field##_show, NULL)
+
+#define EQ3LOOP_STAT_ATTRS(_dir) \
+EQ3LOOP_STAT_ATTR(_dir, bytes); \
+EQ3LOOP_STAT_ATTR(_dir, writes); \
+EQ3LOOP_STAT_ATTR(_dir, full); \
+EQ3LOOP_STAT_ATTR(_dir, write_eagain); \
+EQ3LOOP_STAT_ATTR(_dir, wakeups); \
+EQ3LOOP_STAT_ATTR(_dir, timer_wakeups); \
+EQ3LOOP_STAT_ATTR(_dir, max_fill); \
+EQ3LOOP_STAT_ATTR(_dir, read_bytes); \
+EQ3LOOP_STAT_ATTR(_dir, reads); \
+EQ3LOOP_STAT_ATTR(_dir, read_eagain); \
+static struct attribute *eq3loop_##_dir##_attrs[] = { \
+	&dev_attr_##_dir##_bytes.attr, \
+	&dev_attr_##_dir##_writes.attr, \
+	&dev_attr_##_dir##_full.attr, \
+	&dev_attr_##_dir##_write_eagain.attr, \
+	&dev_attr_##_dir##_wakeups.attr, \
+	&dev_attr_##_dir##_timer_wakeups.attr, \
+	&dev_attr_##_dir##_max_fill.attr, \
+	&dev_attr_##_dir##_read_bytes.attr, \
+	&dev_attr_##_dir##_reads.attr, \
+	&dev_attr_##_dir##_read_eagain.attr, \
+	NULL, \
+}; \
+static const struct attribute_group eq3loop_##_dir##_group = { \
+	.name = #_dir, \
+	.attrs = eq3loop_##_dir##_attrs, \
+}
+
+/* per direction counters in /sys/class/eq3loop/<slave>/{master2slave,slave2master}/ */
+EQ3LOOP_STAT_ATTRS(master2slave);
+EQ3LOOP_STAT_ATTRS(slave2master);
+
+static const struct attribute_group *eq3loop_stats_groups[] = {
+	&eq3loop_master2slave_group,
+	&eq3loop_slave2master_group,
+	NULL,
+};
+
 static long eq3loop_create_slave_dev( struct file *filp, const char* name )
 {
 	int channel_index = 0;
@@ -831,11 +1071,12 @@ static long eq3loop_create_slave_dev( struct file *filp, const char* name )
 	if (down_interruptible(&control_data->sem))
 	return -ERESTARTSYS;
 	
-	while( (channel_index < EQ3LOOP_NUMBER_OF_CHANNELS) &&  (control_data->channels[channel_index].created) )
+	/* a channel whose master is gone is still in use until its slave is closed */
+	while( (channel_index < number_of_channels) && (control_data->channels[channel_index].created || control_data->channels[channel_index].slave_open_count) )
 	{
 		channel_index++;
 	}
-	if( channel_index >= EQ3LOOP_NUMBER_OF_CHANNELS )
+	if( channel_index >= number_of_channels )
 	{
 		ret = -EINVAL;
 		goto out;
@@ -846,29 +1087,43 @@ static long eq3loop_create_slave_dev( struct file *filp, const char* name )
 	channel->devnode = MKDEV(MAJOR(control_data->devnode), MINOR(control_data->devnode) + channel_index + 1);
 	strncpy( channel->name, name, sizeof(channel->name)-1 );
 	
-	if( !device_create(control_data->class, NULL, channel->devnode, "%s", name) )
+	channel->master2slave_stats.dir = DIR_MASTER2SLAVE;
+	channel->slave2master_stats.dir = DIR_SLAVE2MASTER;
+	eq3loop_init_frame_wakeup( &channel->master2slave_wakeup, &channel->master2slaveq, &channel->master2slave_stats );
+	eq3loop_init_frame_wakeup( &channel->slave2master_wakeup, &channel->slave2masterq, &channel->slave2master_stats );
+	channel->frame_wakeup = frame_wakeup;
+	channel->frame_wakeup_delay = ns_to_ktime( (u64)frame_wakeup_delay_us * NSEC_PER_USEC );
+	
+	channel->buf_size = buf_size;
+	channel->master2slave_buf.buf = vmalloc( channel->buf_size );
+	channel->slave2master_buf.buf = vmalloc( channel->buf_size );
+	conn = kzalloc( sizeof(struct eq3loop_connection_data), GFP_KERNEL );
+	if( !conn || !channel->master2slave_buf.buf || !channel->slave2master_buf.buf )
 	{
-		ret = -EBUSY;
+		kfree( conn );
+		eq3loop_free_buffers( channel );
+		ret = -ENOMEM;
 		goto out;
 	}
 	
-	printk( KERN_INFO EQ3LOOP_DRIVER_NAME ": created slave %s\n", name );
-
-	conn = kzalloc( sizeof(struct eq3loop_connection_data), GFP_KERNEL );
-	if( !conn )
+	if( !device_create_with_groups(control_data->class, NULL, channel->devnode, channel, eq3loop_stats_groups, "%s", name) )
 	{
-		ret = -ENOMEM;
+		kfree( conn );
+		eq3loop_free_buffers( channel );
+		ret = -EBUSY;
 		goto out;
 	}
 	
+	printk( KERN_INFO EQ3LOOP_DRIVER_NAME ": created slave %s (buffer size %d)\n", name, channel->buf_size );
+	
 	sema_init(&channel->sem, 1);
+	mutex_init(&channel->master2slave_read_lock);
+	mutex_init(&channel->master2slave_write_lock);
+	mutex_init(&channel->slave2master_read_lock);
+	mutex_init(&channel->slave2master_write_lock);
 	init_waitqueue_head(&channel->master2slaveq);
 	init_waitqueue_head(&channel->slave2masterq);
 	
-	
-	channel->master2slave_buf.buf = channel->_master2slave_buf;
-	channel->slave2master_buf.buf = channel->_slave2master_buf;
-	
 	smp_mb();
 	
 	channel->created = 1;
@@ -930,10 +1185,8 @@ static int eq3loop_open_slave(struct eq3loop_channel_data* channel, struct file
 	set_bit( EVENT_BIT_SLAVE_OPENED, &channel->pending_events );
 	set_bit( STATE_BIT_SLAVE_OPENED, &channel->pending_events );
 	
-	channel->master2slave_buf.head = 0;
-	channel->master2slave_buf.tail = 0;
-	
-	smp_mb();
+	/* drop stale master data; only the (absent) slave consumer may move tail */
+	smp_store_release( &channel->master2slave_buf.tail, READ_ONCE(channel->master2slave_buf.head) );
 	
 out:
 	up( &channel->sem );
@@ -949,6 +1202,7 @@ out:
 		conn->poll = eq3loop_poll_slave;
 		filp->private_data = conn;
 		wake_up_interruptible( &channel->slave2masterq );
+		wake_up_interruptible( &channel->master2slaveq );
 	}
 	return ret;
 }
@@ -966,7 +1220,7 @@ static int eq3loop_open(struct inode *inode, struct file *filp)
 		return eq3loop_open_ctrl( filp );
 	}else{
 		unsigned int channel_index = MINOR( inode->i_rdev ) - MINOR(control_data->devnode) - 1;
-		if( channel_index >= EQ3LOOP_NUMBER_OF_CHANNELS )
+		if( channel_index >= number_of_channels )
 		{
 			return -ENODEV;
 		}
@@ -983,8 +1237,14 @@ static struct file_operations eq3loop_fops = {
 #else
 	.llseek		= no_llseek,
 #endif
-	.read		= eq3loop_read,
-	.write		= eq3loop_write,
+	.read_iter	= eq3loop_read_iter,
+	.write_iter	= eq3loop_write_iter,
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 5, 0))
+	.splice_read	= copy_splice_read,
+#else
+	.splice_read	= generic_file_splice_read,
+#endif
+	.splice_write	= iter_file_splice_write,
 	.open		= eq3loop_open,
 	.release	= eq3loop_close,
 	.poll       = eq3loop_poll,
@@ -1000,13 +1260,25 @@ static int __init eq3loop_init(void)
 {
 	int ret = 0;
 
+	if( number_of_channels < 1 || number_of_channels > EQ3LOOP_MAX_NUMBER_OF_CHANNELS )
+	{
+		printk(KERN_ERR EQ3LOOP_DRIVER_NAME ": Invalid number of channels %d\n", number_of_channels);
+		return -EINVAL;
+	}
+
 	control_data = kzalloc(sizeof(struct eq3loop_control_data), GFP_KERNEL);
 	if (!control_data) {
 		ret = -ENOMEM;
 		goto out;
 	}
 
-	ret = alloc_chrdev_region(&control_data->devnode, 0, EQ3LOOP_NUMBER_OF_CHANNELS + 1, EQ3LOOP_DRIVER_NAME);
+	control_data->channels = kcalloc(number_of_channels, sizeof(struct eq3loop_channel_data), GFP_KERNEL);
+	if (!control_data->channels) {
+		ret = -ENOMEM;
+		goto out_free;
+	}
+
+	ret = alloc_chrdev_region(&control_data->devnode, 0, number_of_channels + 1, EQ3LOOP_DRIVER_NAME);
 	if( ret )
 	{
 		printk(KERN_ERR EQ3LOOP_DRIVER_NAME ": Unable to get device number region\n");
@@ -1016,7 +1288,7 @@ static int __init eq3loop_init(void)
 	cdev_init(&control_data->cdev, &eq3loop_fops);
 	control_data->cdev.owner=THIS_MODULE;
 	control_data->cdev.ops=&eq3loop_fops;
-	ret=cdev_add(&control_data->cdev, control_data->devnode, EQ3LOOP_NUMBER_OF_CHANNELS + 1);
+	ret=cdev_add(&control_data->cdev, control_data->devnode, number_of_channels + 1);
 	if(ret){
 		printk(KERN_ERR EQ3LOOP_DRIVER_NAME ": Unable to add driver\n");
 		goto out_unregister_chrdev_region;
@@ -1045,9 +1317,10 @@ static int __init eq3loop_init(void)
 	cdev_del(&control_data->cdev);
 	
 	out_unregister_chrdev_region:
-	unregister_chrdev_region(control_data->devnode, EQ3LOOP_NUMBER_OF_CHANNELS + 1);
+	unregister_chrdev_region(control_data->devnode, number_of_channels + 1);
 	
 	out_free:
+	kfree(control_data->channels);
 	kfree(control_data);
 out:
 	return ret;
@@ -1055,18 +1328,51 @@ out:
 
 static void __exit eq3loop_exit(void)
 {
+	int i;
 
-	unregister_chrdev_region(control_data->devnode, EQ3LOOP_NUMBER_OF_CHANNELS + 1);
+	unregister_chrdev_region(control_data->devnode, number_of_channels + 1);
 	device_destroy(control_data->class, MKDEV(MAJOR(control_data->devnode), MINOR(control_data->devnode)));
 	class_destroy(control_data->class);
 	cdev_del(&control_data->cdev);
 	
+	for( i = 0; i < number_of_channels; i++ )
+	{
+		eq3loop_free_buffers( &control_data->channels[i] );
+	}
+	kfree(control_data->channels);
 	kfree(control_data);
 	
 	control_data = NULL;
 
 }
 
+static int eq3loop_set_buf_size(const char *val, const struct kernel_param *kp)
+{
+	unsigned int size;
+
+	if( kstrtouint(val, 0, &size) || !is_power_of_2(size) || size < MIN_BUFSIZE || size > MAX_BUFSIZE )
+	{
+		return -EINVAL;
+	}
+
+	*((int *)kp->arg) = size;
+	return 0;
+}
+
+static const struct kernel_param_ops eq3loop_buf_size_param_ops = {
+	.set = eq3loop_set_buf_size,
+	.get = param_get_int,
+};
+
+module_param_named(channels, number_of_channels, int, S_IRUGO);
+MODULE_PARM_DESC(channels, "Number of loopback channels (1-64, default 4)");
+module_param_cb(buf_size, &eq3loop_buf_size_param_ops, &buf_size, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(buf_size, "Size of each direction's ring buffer of newly created channels (power of two, 256-65536, default 1024)");
+module_param(frame_wakeup, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(frame_wakeup, "Wake readers of newly created channels only on complete HM frames or after frame_wakeup_delay_us (default off)");
+module_param(frame_wakeup_delay_us, uint, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(frame_wakeup_delay_us, "Deadline in microseconds for waking readers on incomplete frames in frame wakeup mode (default 2000)");
+
 module_init(eq3loop_init);
 module_exit(eq3loop_exit);
 MODULE_DESCRIPTION("eQ-3 IPC loopback char driver");
@@ -0,0 +1,73 @@
+/*
+* Tracepoints for the eQ-3 char loopback driver
+*
+* This program is free software; you can redistribute it and/or modify
+* it under the terms of the GNU General Public License as published by
+* the Free Software Foundation; either version 2 of the License, or
+* (at your option) any later version.
+*
+* This program is distributed in the hope that it will be useful,
+* but WITHOUT ANY WARRANTY; without even the implied warranty of
+* MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE. See the GNU
+* General Public License for more details.
+*/
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM eq3loop
+
+#if !defined(_EQ3_CHAR_LOOP_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _EQ3_CHAR_LOOP_TRACE_H
+
+#include <linux/tracepoint.h>
+
+/*
+* name is the 32 byte channel name. pos is the number of bytes written to (resp. read from) the
+* ring before this transfer, so the queueing delay of a byte is the time between the write and
+* the read event covering its pos.
+*/
+DECLARE_EVENT_CLASS(eq3loop_xfer,
+
+	TP_PROTO(const char *name, int dir, unsigned long pos, size_t count, int fill),
+
+	TP_ARGS(name, dir, pos, count, fill),
+
+	TP_STRUCT__entry(
+		__array(char, name, 32)
+		__field(int, dir)
+		__field(unsigned long, pos)
+		__field(size_t, count)
+		__field(int, fill)
+	),
+
+	TP_fast_assign(
+		memcpy(__entry->name, name, sizeof(__entry->name));
+		__entry->dir = dir;
+		__entry->pos = pos;
+		__entry->count = count;
+		__entry->fill = fill;
+	),
+
+	TP_printk("%s %s pos=%lu count=%zu fill=%d",
+		__entry->name,
+		__print_symbolic(__entry->dir, { 0, "master2slave" }, { 1, "slave2master" }),
+		__entry->pos, __entry->count, __entry->fill)
+);
+
+DEFINE_EVENT(eq3loop_xfer, eq3loop_write,
+	TP_PROTO(const char *name, int dir, unsigned long pos, size_t count, int fill),
+	TP_ARGS(name, dir, pos, count, fill)
+);
+
+DEFINE_EVENT(eq3loop_xfer, eq3loop_read,
+	TP_PROTO(const char *name, int dir, unsigned long pos, size_t count, int fill),
+	TP_ARGS(name, dir, pos, count, fill)
+);
+
+#endif /* _EQ3_CHAR_LOOP_TRACE_H */
+
+/* this part must be outside the include guard */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE eq3_char_loop_trace
+#include <trace/define_trace.h>
@@ -29,6 +29,7 @@
 #include <linux/poll.h>
 #include <linux/spinlock.h>
 #include <linux/circ_buf.h>
+#include <linux/log2.h>
 #include <linux/proc_fs.h>
 #include <linux/seq_file.h>
 #include <linux/wait.h>
@@ -39,10 +40,14 @@
 #include <linux/gpio.h>
 #include <linux/gpio/consumer.h>
 #include <linux/delay.h>
+#include <linux/mutex.h>
+#include <linux/uio.h>
+#include <linux/eventfd.h>
 #include <linux/of.h>
 #include <linux/i2c.h>
 #include <crypto/hash.h>
 #include "generic_raw_uart.h"
+#include "hm.h"
 
 #include "stack_protector.include"
 
@@ -52,11 +57,18 @@
 
 #define CIRCBUF_SIZE 1024
 #define CON_DATA_TX_BUF_SIZE 4096
+#define MIN_BUF_SIZE 256
+#define MAX_BUF_SIZE 65536
+#define FRAME_BUF_SIZE 2048 /*maximum length of a decoded HM frame in frame mode*/
+#define FRAME_RAW_BUF_SIZE (2 * FRAME_BUF_SIZE)
 #define PROC_DEBUG 1
 #define MAX_CONNECTIONS 3
 #define IOCTL_MAGIC 'u'
 #define IOCTL_IOCSPRIORITY _IOW(IOCTL_MAGIC, 1, uint32_t) /* Set the priority for the current channel */
 #define IOCTL_IOCGPRIORITY _IOR(IOCTL_MAGIC, 2, uint32_t) /* Get the priority for the current channel */
+#define IOCTL_IOCSFRAMEMODE _IOW(IOCTL_MAGIC, 3, uint32_t) /* Enable/disable frame mode for the current channel */
+#define IOCTL_IOCGFRAMEMODE _IOR(IOCTL_MAGIC, 4, uint32_t) /* Get the frame mode of the current channel */
+#define IOCTL_IOCSTXEVENTFD _IO(IOCTL_MAGIC, 5) /* Set an eventfd signalled on TX completion, the fd is passed by value, -1 to remove */
 #define IOCTL_IOCRESET_RADIO_MODULE _IO(IOCTL_MAGIC, 0x81) /* Reset the radio module */
 #define IOCTL_IOCGDEVINFO _IOW(IOCTL_MAGIC, 0x82, char[MAX_DEVICE_TYPE_LEN]) /* Get information about the raw uart device */
 
@@ -72,13 +84,19 @@ static struct class *class;
 struct generic_raw_uart_instance
 {
   spinlock_t lock_tx;                        /*TX lock for accessing tx_connection*/
+  spinlock_t lock_rx;                        /*RX lock, protects rxbuf against resizing*/
   struct semaphore sem;                      /*semaphore for accessing this struct*/
   wait_queue_head_t readq;                   /*wait queue for read operations*/
   wait_queue_head_t writeq;                  /*wait queue for write operations*/
   struct circ_buf rxbuf;                     /*RX buffer*/
+  struct mutex rx_read_lock;                 /*serialises the readers of rxbuf*/
+  int rxbuf_size;                            /*size of the RX buffer, power of two*/
+  int txbuf_size;                            /*size of the TX buffer of new connections*/
   int open_count;                            /*number of open connections*/
   bool connection_state;
   struct per_connection_data *tx_connection; /*connection which is currently sending*/
+  bool rx_fanout;                            /*every connection receives all data in its own RX buffer*/
+  struct per_connection_data *rx_connections[MAX_CONNECTIONS]; /*connections fed in fan-out mode, protected by lock_rx*/
   struct termios termios;                    /*dummy termios for emulating ttyp ioctls*/
 
   int reset_pin;
@@ -92,7 +110,11 @@ struct generic_raw_uart_instance
   int count_parity;      /*Statistic counter: Number of parity errors*/
   int count_frame;       /*Statistic counter: Number of frame errors*/
   int count_overrun;     /*Statistic counter: Number of RX overruns in hardware FIFO*/
-  int count_buf_overrun; /*Statistic counter: Number of RX overruns in user space buffer*/
+  int count_buf_overrun; /*Statistic counter: Number of bytes dropped due to a full RX buffer*/
+  int count_hm_frames;       /*Statistic counter: Number of HM frames delivered in frame mode*/
+  int count_hm_frame_errors; /*Statistic counter: Number of invalid or truncated HM frames dropped in frame mode*/
+  int count_rx_irq;          /*Statistic counter: Number of RX interrupts serviced by the driver*/
+  int count_tx_irq;          /*Statistic counter: Number of TX interrupts serviced by the driver*/
 
   struct raw_uart_driver *driver;
   dev_t devid;
@@ -111,21 +133,36 @@ struct generic_raw_uart_instance
 
 struct per_connection_data
 {
-  unsigned char txbuf[CON_DATA_TX_BUF_SIZE];
+  size_t tx_buf_size;     /*size of txbuf*/
   size_t tx_buf_length;   /*length of tx frame transmitted from userspace*/
   size_t tx_buf_index;    /*index into txbuf*/
   unsigned long priority; /*priority of the corresponding channel*/
   struct semaphore sem;   /*semaphore for accessing this struct.*/
+  struct circ_buf rxbuf;  /*own RX buffer in fan-out mode, otherwise unused*/
+  struct mutex rx_read_lock; /*serialises the readers of the own RX buffer*/
+  bool frame_mode;              /*read() returns exactly one decoded and CRC checked HM frame*/
+  struct mutex frame_lock;      /*lock for the frame mode buffers*/
+  unsigned char *frame_raw;     /*received, still escaped data in frame mode*/
+  size_t frame_raw_len;         /*number of bytes in frame_raw*/
+  unsigned char *frame_buf;     /*decoded frame ready to be read*/
+  size_t frame_len;             /*length of the frame in frame_buf, 0 if none is ready*/
+  struct eventfd_ctx *tx_eventfd; /*signalled when a transmission of this connection ended, protected by lock_tx*/
+  bool tx_aborted;                /*last transmission was preempted by a higher priority connection, protected by lock_tx*/
+  unsigned char txbuf[];
 };
 
+static int rx_buf_size = CIRCBUF_SIZE;
+static int tx_buf_size = CON_DATA_TX_BUF_SIZE;
+
 static ssize_t generic_raw_uart_read(struct file *filep, char __user *buf, size_t count, loff_t *offset);
-static ssize_t generic_raw_uart_write(struct file *filep, const char __user *buf, size_t count, loff_t *offset);
+static ssize_t generic_raw_uart_write_iter(struct kiocb *iocb, struct iov_iter *from);
 static int generic_raw_uart_open(struct inode *inode, struct file *filep);
 static int generic_raw_uart_close(struct inode *inode, struct file *filep);
 static unsigned int generic_raw_uart_poll(struct file *filep, poll_table *wait);
 static long generic_raw_uart_ioctl(struct file *filep, unsigned int cmd, unsigned long arg);
 static int generic_raw_uart_acquire_sender(struct generic_raw_uart_instance *instance, struct per_connection_data *conn);
 static int generic_raw_uart_send_completed(struct generic_raw_uart_instance *instance, struct per_connection_data *conn);
+static bool generic_raw_uart_take_tx_aborted(struct generic_raw_uart_instance *instance, struct per_connection_data *conn);
 static void generic_raw_uart_tx_queued_unlocked(struct generic_raw_uart_instance *instance);
 #ifdef PROC_DEBUG
 static int generic_raw_uart_proc_show(struct seq_file *m, void *v);
@@ -153,7 +190,7 @@ static struct file_operations generic_raw_uart_fops =
         .llseek         = no_llseek,
 #endif
   .read = generic_raw_uart_read,
-  .write = generic_raw_uart_write,
+  .write_iter = generic_raw_uart_write_iter,
   .open = generic_raw_uart_open,
   .release = generic_raw_uart_close,
   .poll = generic_raw_uart_poll,
@@ -182,106 +219,408 @@ static const struct file_operations generic_raw_uart_proc_fops =
 #endif
 #endif /*PROC_DEBUG*/
 
-static ssize_t generic_raw_uart_read(struct file *filep, char __user *buf, size_t count, loff_t *offset)
+static struct circ_buf *generic_raw_uart_get_rxbuf(struct generic_raw_uart_instance *instance, struct per_connection_data *conn)
 {
-  struct generic_raw_uart_instance *instance = container_of(filep->f_inode->i_cdev, struct generic_raw_uart_instance, cdev);
-  int ret = 0;
+  return conn->rxbuf.buf ? &conn->rxbuf : &instance->rxbuf;
+}
 
-  if (down_interruptible(&instance->sem))
-  {
-    ret = -ERESTARTSYS;
-    goto exit;
-  }
+static struct mutex *generic_raw_uart_get_rx_read_lock(struct generic_raw_uart_instance *instance, struct per_connection_data *conn)
+{
+  return conn->rxbuf.buf ? &conn->rx_read_lock : &instance->rx_read_lock;
+}
 
-  while (!CIRC_CNT(instance->rxbuf.head, instance->rxbuf.tail, CIRCBUF_SIZE)) /* Wait for data, if there's currently nothing to read */
+/* Consumer for kernel space buffers, see generic_raw_uart_read() */
+static size_t generic_raw_uart_pull_rx(struct generic_raw_uart_instance *instance, struct per_connection_data *conn, struct circ_buf *rxbuf, unsigned char *dst, size_t count)
+{
+  struct mutex *read_lock = generic_raw_uart_get_rx_read_lock(instance, conn);
+  int head;
+  int tail;
+  size_t len;
+  size_t len_to_end;
+
+  mutex_lock(read_lock);
+
+  head = smp_load_acquire(&rxbuf->head);
+  tail = rxbuf->tail;
+
+  len = min(count, (size_t)CIRC_CNT(head, tail, instance->rxbuf_size));
+  len_to_end = min(len, (size_t)CIRC_CNT_TO_END(head, tail, instance->rxbuf_size));
+  memcpy(dst, rxbuf->buf + tail, len_to_end);
+  memcpy(dst + len_to_end, rxbuf->buf, len - len_to_end);
+
+  smp_store_release(&rxbuf->tail, (tail + len) & (instance->rxbuf_size - 1));
+
+  mutex_unlock(read_lock);
+  return len;
+}
+
+static void generic_raw_uart_drop_frame_raw(struct per_connection_data *conn, size_t len)
+{
+  conn->frame_raw_len -= len;
+  memmove(conn->frame_raw, conn->frame_raw + len, conn->frame_raw_len);
+}
+
+/*
+ * Searches frame_raw for a complete frame, decodes and validates it. Returns
+ * the length of the decoded frame in frame_buf or 0, if more data is needed.
+ * Must be called with frame_lock held.
+ */
+static size_t generic_raw_uart_extract_frame(struct generic_raw_uart_instance *instance, struct per_connection_data *conn)
+{
+  unsigned char *start;
+  unsigned char *raw = conn->frame_raw;
+  unsigned char cur;
+  unsigned char hdr[3];
+  struct hm_frame frame;
+  size_t pos;
+  size_t decoded;
+  size_t expected;
+  size_t len;
+
+  while (conn->frame_raw_len > 0)
   {
-    up(&instance->sem);
-    if (filep->f_flags & O_NONBLOCK)
+    /* skip everything before the start of the next frame */
+    start = memchr(raw, 0xfd, conn->frame_raw_len);
+    if (!start)
     {
-      ret = -EAGAIN;
-      goto exit;
+      conn->frame_raw_len = 0;
+      return 0;
     }
+    generic_raw_uart_drop_frame_raw(conn, start - raw);
 
-    if (wait_event_interruptible(instance->readq, CIRC_CNT(instance->rxbuf.head, instance->rxbuf.tail, CIRCBUF_SIZE)))
+    /* determine the escaped length of the frame */
+    hdr[0] = 0xfd;
+    decoded = 1;
+    expected = 0;
+    for (pos = 1; pos < conn->frame_raw_len; pos++)
     {
-      ret = -ERESTARTSYS;
-      goto exit;
+      cur = raw[pos];
+      if (cur == 0xfd)
+        break;
+      if (cur == 0xfc)
+        continue;
+
+      if (raw[pos - 1] == 0xfc)
+        cur |= 0x80;
+
+      if (decoded < sizeof(hdr))
+        hdr[decoded] = cur;
+
+      if (++decoded == sizeof(hdr))
+        expected = ((hdr[1] << 8) | hdr[2]) + 5;
+
+      if (decoded == expected)
+        break;
     }
 
-    if (down_interruptible(&instance->sem))
+    if (pos < conn->frame_raw_len && raw[pos] == 0xfd)
     {
-      ret = -ERESTARTSYS;
-      goto exit;
+      /* next frame started before this one was complete */
+      instance->count_hm_frame_errors++;
+      generic_raw_uart_drop_frame_raw(conn, pos);
+      continue;
+    }
+
+    if (expected > FRAME_BUF_SIZE)
+    {
+      instance->count_hm_frame_errors++;
+      generic_raw_uart_drop_frame_raw(conn, 1);
+      continue;
+    }
+
+    if (decoded != expected)
+    {
+      /* frame is incomplete, wait for more data */
+      if (conn->frame_raw_len == FRAME_RAW_BUF_SIZE)
+      {
+        instance->count_hm_frame_errors++;
+        conn->frame_raw_len = 0;
+      }
+      return 0;
     }
+
+    len = decodeFrameBuffer(raw, conn->frame_buf, pos + 1);
+    generic_raw_uart_drop_frame_raw(conn, pos + 1);
+
+    if (tryParseFrame(conn->frame_buf, len, &frame))
+    {
+      instance->count_hm_frames++;
+      conn->frame_len = len;
+      return len;
+    }
+
+    instance->count_hm_frame_errors++;
   }
 
-  count = min((int)count, CIRC_CNT_TO_END(instance->rxbuf.head, instance->rxbuf.tail, CIRCBUF_SIZE));
-  if (copy_to_user(buf, instance->rxbuf.buf + instance->rxbuf.tail, count))
+  return 0;
+}
+
+/*
+ * Returns the length of the next complete frame in frame_buf, pulling more
+ * data from the RX buffer as needed, or 0 if no complete frame is available.
+ * Must be called with frame_lock held.
+ */
+static size_t generic_raw_uart_next_frame(struct generic_raw_uart_instance *instance, struct per_connection_data *conn, struct circ_buf *rxbuf)
+{
+  size_t len;
+
+  if (conn->frame_len)
+    return conn->frame_len;
+
+  while (true)
   {
-    ret = -EFAULT;
-    goto exit_sem;
+    len = generic_raw_uart_extract_frame(instance, conn);
+    if (len)
+      return len;
+
+    len = generic_raw_uart_pull_rx(instance, conn, rxbuf, conn->frame_raw + conn->frame_raw_len, FRAME_RAW_BUF_SIZE - conn->frame_raw_len);
+    if (len == 0)
+      return 0;
+
+    conn->frame_raw_len += len;
   }
-  ret = count;
+}
+
+static ssize_t generic_raw_uart_read_frame(struct file *filep, struct generic_raw_uart_instance *instance, struct circ_buf *rxbuf, char __user *buf, size_t count)
+{
+  struct per_connection_data *conn = filep->private_data;
+  ssize_t ret;
 
-  smp_mb();
-  instance->rxbuf.tail += count;
-  if (instance->rxbuf.tail >= CIRCBUF_SIZE)
+  while (true)
   {
-    instance->rxbuf.tail -= CIRCBUF_SIZE;
+    if (mutex_lock_interruptible(&conn->frame_lock))
+      return -ERESTARTSYS;
+
+    ret = generic_raw_uart_next_frame(instance, conn, rxbuf);
+    if (ret > 0)
+    {
+      if (count < (size_t)ret)
+      {
+        /* the frame stays available for a read with a larger buffer */
+        ret = -EMSGSIZE;
+      }
+      else if (copy_to_user(buf, conn->frame_buf, ret))
+      {
+        ret = -EFAULT;
+      }
+      else
+      {
+        /* decode a further frame which was already received, so poll() can report it */
+        conn->frame_len = 0;
+        generic_raw_uart_extract_frame(instance, conn);
+      }
+    }
+
+    mutex_unlock(&conn->frame_lock);
+
+    if (ret != 0)
+      return ret;
+
+    if (filep->f_flags & O_NONBLOCK)
+      return -EAGAIN;
+
+    if (wait_event_interruptible(instance->readq, CIRC_CNT(smp_load_acquire(&rxbuf->head), READ_ONCE(rxbuf->tail), instance->rxbuf_size)))
+      return -ERESTARTSYS;
   }
+}
 
-exit_sem:
-  up(&instance->sem);
+static int generic_raw_uart_set_frame_mode(struct per_connection_data *conn, bool enable)
+{
+  mutex_lock(&conn->frame_lock);
 
-exit:
-  return ret;
+  if (enable && !conn->frame_raw)
+  {
+    conn->frame_raw = kmalloc(FRAME_RAW_BUF_SIZE, GFP_KERNEL);
+    conn->frame_buf = kmalloc(FRAME_BUF_SIZE, GFP_KERNEL);
+    if (!conn->frame_raw || !conn->frame_buf)
+    {
+      kfree(conn->frame_raw);
+      kfree(conn->frame_buf);
+      conn->frame_raw = NULL;
+      conn->frame_buf = NULL;
+      mutex_unlock(&conn->frame_lock);
+      return -ENOMEM;
+    }
+  }
+
+  /* partially received frames are discarded when switching the mode */
+  conn->frame_raw_len = 0;
+  conn->frame_len = 0;
+  WRITE_ONCE(conn->frame_mode, enable);
+
+  mutex_unlock(&conn->frame_lock);
+  return 0;
 }
 
-static ssize_t generic_raw_uart_write(struct file *filep, const char __user *buf, size_t count, loff_t *offset)
+static ssize_t generic_raw_uart_read(struct file *filep, char __user *buf, size_t count, loff_t *offset)
 {
   struct generic_raw_uart_instance *instance = container_of(filep->f_inode->i_cdev, struct generic_raw_uart_instance, cdev);
   struct per_connection_data *conn = filep->private_data;
-  int ret = 0;
-
-  if (down_interruptible(&conn->sem))
+  struct circ_buf *rxbuf = generic_raw_uart_get_rxbuf(instance, conn);
+  struct mutex *read_lock = generic_raw_uart_get_rx_read_lock(instance, conn);
+  int head;
+  int tail;
+  size_t len;
+  size_t len_to_end;
+
+  if (READ_ONCE(conn->frame_mode))
+    return generic_raw_uart_read_frame(filep, instance, rxbuf, buf, count);
+
+  /*
+   * Each RX ring has a single producer (the driver's RX path), but the shared
+   * ring can have several readers. copy_to_user() may sleep between reading
+   * and advancing the tail, so readers are serialised by the ring's read
+   * lock. The producer never takes it, so the RX path stays lock-free.
+   */
+  while (true)
   {
-    ret = -ERESTARTSYS;
-    goto exit;
+    if (mutex_lock_interruptible(read_lock))
+      return -ERESTARTSYS;
+
+    head = smp_load_acquire(&rxbuf->head);
+    tail = rxbuf->tail;
+
+    len = min(count, (size_t)CIRC_CNT(head, tail, instance->rxbuf_size));
+    if (len == 0) /* Wait for data, if there's currently nothing to read */
+    {
+      mutex_unlock(read_lock);
+
+      if (count == 0)
+        return 0;
+
+      if (filep->f_flags & O_NONBLOCK)
+        return -EAGAIN;
+
+      if (wait_event_interruptible(instance->readq, CIRC_CNT(smp_load_acquire(&rxbuf->head), READ_ONCE(rxbuf->tail), instance->rxbuf_size)))
+        return -ERESTARTSYS;
+
+      continue;
+    }
+
+    len_to_end = min(len, (size_t)CIRC_CNT_TO_END(head, tail, instance->rxbuf_size));
+    if (copy_to_user(buf, rxbuf->buf + tail, len_to_end) ||
+        (len > len_to_end && copy_to_user(buf + len_to_end, rxbuf->buf, len - len_to_end)))
+    {
+      mutex_unlock(read_lock);
+      return -EFAULT;
+    }
+
+    smp_store_release(&rxbuf->tail, (tail + len) & (instance->rxbuf_size - 1));
+    mutex_unlock(read_lock);
+    return len;
   }
+}
 
-  if (count > sizeof(conn->txbuf))
+/* Must be called with lock_tx held */
+static void generic_raw_uart_signal_tx_completed(struct per_connection_data *conn)
+{
+  if (conn->tx_eventfd)
   {
-    dev_err(instance->dev, "generic_raw_uart_write(): Error message size.");
-    ret = -EMSGSIZE;
-    goto exit_sem;
+#if (LINUX_VERSION_CODE >= KERNEL_VERSION(6, 8, 0))
+    eventfd_signal(conn->tx_eventfd);
+#else
+    eventfd_signal(conn->tx_eventfd, 1);
+#endif
   }
+}
 
-  if (copy_from_user(conn->txbuf, buf, count))
+/*
+ * Waits until a previous (non-blocking) transmission of the connection has
+ * ended, so txbuf can be reused. Must be called with conn->sem held.
+ *
+ * Returns -EIO once if that transmission was preempted by a higher priority
+ * connection and not sent completely.
+ */
+static int generic_raw_uart_wait_tx_idle(struct generic_raw_uart_instance *instance, struct per_connection_data *conn, bool nonblock)
+{
+  if (nonblock)
   {
-    dev_err(instance->dev, "generic_raw_uart_write(): Copy from user.");
-    ret = -EFAULT;
-    goto exit_sem;
+    if (!generic_raw_uart_send_completed(instance, conn))
+      return -EAGAIN;
+  }
+  else if (wait_event_interruptible(instance->writeq, generic_raw_uart_send_completed(instance, conn)))
+  {
+    return -ERESTARTSYS;
   }
 
+  return generic_raw_uart_take_tx_aborted(instance, conn) ? -EIO : 0;
+}
+
+/*
+ * Sends the first count bytes of txbuf. Must be called with conn->sem held.
+ *
+ * In non-blocking mode the transmission is only started and the function
+ * returns immediately. The end of the transmission is signalled by POLLOUT
+ * and the TX eventfd of the connection. If it is preempted by a higher
+ * priority connection, POLLERR is signalled and the next write fails with
+ * -EIO.
+ */
+static ssize_t generic_raw_uart_send(struct generic_raw_uart_instance *instance, struct per_connection_data *conn, size_t count, bool nonblock)
+{
   conn->tx_buf_index = 0;
   conn->tx_buf_length = count;
   smp_wmb(); /*Wait until completion of all writes*/
 
+  if (nonblock)
+  {
+    return generic_raw_uart_acquire_sender(instance, conn) ? count : -EAGAIN;
+  }
+
   if (wait_event_interruptible(instance->writeq, generic_raw_uart_acquire_sender(instance, conn)))
   {
-    ret = -ERESTARTSYS;
-    goto exit_sem;
+    return -ERESTARTSYS;
   }
 
   /*wait for sending to complete*/
   if (wait_event_interruptible(instance->writeq, generic_raw_uart_send_completed(instance, conn)))
+  {
+    return -ERESTARTSYS;
+  }
+
+  /*a preemption is already reported by the short count*/
+  generic_raw_uart_take_tx_aborted(instance, conn);
+
+  /*return number of characters actually sent*/
+  return conn->tx_buf_index;
+}
+
+/*
+ * Handles write() and writev(): all segments, e.g. several frames, are
+ * gathered into txbuf and sent with a single sender arbitration and wakeup.
+ */
+static ssize_t generic_raw_uart_write_iter(struct kiocb *iocb, struct iov_iter *from)
+{
+  struct file *filep = iocb->ki_filp;
+  struct generic_raw_uart_instance *instance = container_of(filep->f_inode->i_cdev, struct generic_raw_uart_instance, cdev);
+  struct per_connection_data *conn = filep->private_data;
+  size_t count = iov_iter_count(from);
+  ssize_t ret = 0;
+
+  if (down_interruptible(&conn->sem))
   {
     ret = -ERESTARTSYS;
+    goto exit;
+  }
+
+  if (count > conn->tx_buf_size)
+  {
+    dev_err(instance->dev, "generic_raw_uart_write_iter(): Error message size.");
+    ret = -EMSGSIZE;
     goto exit_sem;
   }
 
-  /*return number of characters actually sent*/
-  ret = conn->tx_buf_index;
+  ret = generic_raw_uart_wait_tx_idle(instance, conn, filep->f_flags & O_NONBLOCK);
+  if (ret)
+    goto exit_sem;
+
+  if (copy_from_iter(conn->txbuf, count, from) != count)
+  {
+    dev_err(instance->dev, "generic_raw_uart_write_iter(): Copy from user.");
+    ret = -EFAULT;
+    goto exit_sem;
+  }
+
+  ret = generic_raw_uart_send(instance, conn, count, filep->f_flags & O_NONBLOCK);
 
 exit_sem:
   up(&conn->sem);
@@ -341,6 +680,9 @@ exit:
 static int generic_raw_uart_open(struct inode *inode, struct file *filep)
 {
   int ret;
+  int txbuf_size;
+  int i;
+  unsigned long flags;
   struct per_connection_data *conn;
   struct generic_raw_uart_instance *instance = container_of(inode->i_cdev, struct generic_raw_uart_instance, cdev);
 
@@ -354,9 +696,22 @@ static int generic_raw_uart_open(struct inode *inode, struct file *filep)
     return -ENODEV;
   }
 
+  txbuf_size = READ_ONCE(instance->txbuf_size);
+  conn = kzalloc(sizeof(struct per_connection_data) + txbuf_size, GFP_KERNEL);
+  if (!conn)
+  {
+    return -ENOMEM;
+  }
+
+  conn->tx_buf_size = txbuf_size;
+  sema_init(&conn->sem, 1);
+  mutex_init(&conn->frame_lock);
+  mutex_init(&conn->rx_read_lock);
+
   /*Get semaphore*/
   if (down_interruptible(&instance->sem))
   {
+    kfree(conn);
     return -ERESTARTSYS;
   }
 
@@ -368,6 +723,7 @@ static int generic_raw_uart_open(struct inode *inode, struct file *filep)
     /*Release semaphore*/
     up(&instance->sem);
 
+    kfree(conn);
     return -EMFILE;
   }
 
@@ -378,9 +734,23 @@ static int generic_raw_uart_open(struct inode *inode, struct file *filep)
     /*Release semaphore*/
     up(&instance->sem);
 
+    kfree(conn);
     return -ENODEV;
   }
 
+  if (instance->rx_fanout)
+  {
+    conn->rxbuf.buf = kmalloc(instance->rxbuf_size, GFP_KERNEL);
+    if (!conn->rxbuf.buf)
+    {
+      /*Release semaphore*/
+      up(&instance->sem);
+
+      kfree(conn);
+      return -ENOMEM;
+    }
+  }
+
   if (!instance->open_count) /*Enable HW for the first connection.*/
   {
     ret = instance->driver->start_connection(&instance->raw_uart);
@@ -388,25 +758,38 @@ static int generic_raw_uart_open(struct inode *inode, struct file *filep)
     {
       /*Release semaphore*/
       up(&instance->sem);
+      kfree(conn->rxbuf.buf);
+      kfree(conn);
       return ret;
     }
 
+    spin_lock_irqsave(&instance->lock_rx, flags);
     instance->rxbuf.head = instance->rxbuf.tail = 0;
+    spin_unlock_irqrestore(&instance->lock_rx, flags);
 
     init_waitqueue_head(&instance->writeq);
     init_waitqueue_head(&instance->readq);
   }
 
+  if (instance->rx_fanout)
+  {
+    spin_lock_irqsave(&instance->lock_rx, flags);
+    for (i = 0; i < MAX_CONNECTIONS; i++)
+    {
+      if (!instance->rx_connections[i])
+      {
+        instance->rx_connections[i] = conn;
+        break;
+      }
+    }
+    spin_unlock_irqrestore(&instance->lock_rx, flags);
+  }
+
   instance->open_count++;
 
   /*Release semaphore*/
   up(&instance->sem);
 
-  conn = kmalloc(sizeof(struct per_connection_data), GFP_KERNEL);
-  memset(conn, 0, sizeof(struct per_connection_data));
-
-  sema_init(&conn->sem, 1);
-
   filep->private_data = (void *)conn;
 
   return 0;
@@ -416,12 +799,51 @@ static int generic_raw_uart_close(struct inode *inode, struct file *filep)
 {
   struct per_connection_data *conn = filep->private_data;
   struct generic_raw_uart_instance *instance = container_of(inode->i_cdev, struct generic_raw_uart_instance, cdev);
+  unsigned long flags;
+  unsigned long timeout;
+  size_t pending = 0;
+  int i;
 
   if (down_interruptible(&conn->sem))
   {
     return -ERESTARTSYS;
   }
 
+  spin_lock_irqsave(&instance->lock_tx, flags);
+  if (instance->tx_connection == conn)
+    pending = conn->tx_buf_length - conn->tx_buf_index;
+  spin_unlock_irqrestore(&instance->lock_tx, flags);
+
+  /* let a pending non-blocking transmission finish (10 bits per byte), abort it if it takes much longer */
+  timeout = HZ + DIV_ROUND_UP(pending * 10 * HZ, BAUD);
+  if (!wait_event_timeout(instance->writeq, generic_raw_uart_send_completed(instance, conn), timeout))
+  {
+    spin_lock_irqsave(&instance->lock_tx, flags);
+    if (instance->tx_connection == conn)
+    {
+      instance->driver->stop_tx(&instance->raw_uart);
+      instance->tx_connection = NULL;
+      wake_up_interruptible(&instance->writeq);
+    }
+    spin_unlock_irqrestore(&instance->lock_tx, flags);
+  }
+
+  if (conn->tx_eventfd)
+    eventfd_ctx_put(conn->tx_eventfd);
+
+  spin_lock_irqsave(&instance->lock_rx, flags);
+  for (i = 0; i < MAX_CONNECTIONS; i++)
+  {
+    if (instance->rx_connections[i] == conn)
+    {
+      instance->rx_connections[i] = NULL;
+    }
+  }
+  spin_unlock_irqrestore(&instance->lock_rx, flags);
+
+  kfree(conn->rxbuf.buf);
+  kfree(conn->frame_raw);
+  kfree(conn->frame_buf);
   kfree(conn);
 
   if (down_interruptible(&instance->sem))
@@ -450,20 +872,32 @@ static unsigned int generic_raw_uart_poll(struct file *filep, poll_table *wait)
 {
   struct generic_raw_uart_instance *instance = container_of(filep->f_inode->i_cdev, struct generic_raw_uart_instance, cdev);
   struct per_connection_data *conn = filep->private_data;
+  struct circ_buf *rxbuf;
   unsigned long lock_flags = 0;
   unsigned int mask = 0;
 
   poll_wait(filep, &instance->readq, wait);
   poll_wait(filep, &instance->writeq, wait);
 
+  /* a pending transmission of this connection blocks POLLOUT until it has ended */
   spin_lock_irqsave(&instance->lock_tx, lock_flags);
   if ((instance->tx_connection == NULL) || (instance->tx_connection->priority < conn->priority))
   {
     mask |= POLLOUT | POLLWRNORM;
   }
+  if (conn->tx_aborted)
+  {
+    mask |= POLLERR;
+  }
   spin_unlock_irqrestore(&instance->lock_tx, lock_flags);
 
-  if (CIRC_CNT(instance->rxbuf.head, instance->rxbuf.tail, CIRCBUF_SIZE) > 0)
+  /* in frame mode the data is only decoded by read(), which returns -EAGAIN if the frame is incomplete */
+  rxbuf = generic_raw_uart_get_rxbuf(instance, conn);
+  if (READ_ONCE(conn->frame_mode) && READ_ONCE(conn->frame_len))
+  {
+    mask |= POLLIN | POLLRDNORM;
+  }
+  else if (CIRC_CNT(smp_load_acquire(&rxbuf->head), READ_ONCE(rxbuf->tail), instance->rxbuf_size) > 0)
   {
     mask |= POLLIN | POLLRDNORM;
   }
@@ -475,8 +909,12 @@ static long generic_raw_uart_ioctl(struct file *filep, unsigned int cmd, unsigne
 {
   struct generic_raw_uart_instance *instance = container_of(filep->f_inode->i_cdev, struct generic_raw_uart_instance, cdev);
   struct per_connection_data *conn = filep->private_data;
+  struct circ_buf *rxbuf;
+  struct eventfd_ctx *eventfd;
+  unsigned long lock_flags;
   long ret = 0;
   unsigned long temp;
+  u32 frame_mode;
   char *buf;
 
   if (down_interruptible(&conn->sem))
@@ -513,6 +951,53 @@ static long generic_raw_uart_ioctl(struct file *filep, unsigned int cmd, unsigne
     }
     break;
 
+    /* Set frame mode of the connection */
+  case IOCTL_IOCSFRAMEMODE: /* Set: arg points to the value */
+    if (_access_ok(VERIFY_WRITE, (void __user *)arg, sizeof(u32)))
+    {
+      ret = __get_user(frame_mode, (u32 __user *)arg);
+      if (!ret)
+        ret = generic_raw_uart_set_frame_mode(conn, frame_mode != 0);
+    }
+    else
+    {
+      ret = -EFAULT;
+    }
+    break;
+
+    /* Get frame mode of the connection */
+  case IOCTL_IOCGFRAMEMODE: /* Get: arg is pointer to result */
+    if (_access_ok(VERIFY_READ, (void __user *)arg, sizeof(u32)))
+    {
+      ret = __put_user((u32)conn->frame_mode, (u32 __user *)arg);
+    }
+    else
+    {
+      ret = -EFAULT;
+    }
+    break;
+
+    /* Set eventfd for TX completion notifications */
+  case IOCTL_IOCSTXEVENTFD: /* Set: arg is the file descriptor itself, not a pointer */
+    eventfd = NULL;
+    if ((int)arg >= 0)
+    {
+      eventfd = eventfd_ctx_fdget((int)arg);
+      if (IS_ERR(eventfd))
+      {
+        ret = PTR_ERR(eventfd);
+        break;
+      }
+    }
+
+    spin_lock_irqsave(&instance->lock_tx, lock_flags);
+    swap(conn->tx_eventfd, eventfd);
+    spin_unlock_irqrestore(&instance->lock_tx, lock_flags);
+
+    if (eventfd)
+      eventfd_ctx_put(eventfd);
+    break;
+
   case IOCTL_IOCRESET_RADIO_MODULE:
     ret = generic_raw_uart_reset_radio_module(instance, 1);
     break;
@@ -591,7 +1076,8 @@ static long generic_raw_uart_ioctl(struct file *filep, unsigned int cmd, unsigne
       }
       else
       {
-        temp = CIRC_CNT(instance->rxbuf.head, instance->rxbuf.tail, CIRCBUF_SIZE);
+        rxbuf = generic_raw_uart_get_rxbuf(instance, conn);
+        temp = CIRC_CNT(smp_load_acquire(&rxbuf->head), READ_ONCE(rxbuf->tail), instance->rxbuf_size);
         up(&instance->sem);
         ret = __put_user(temp, (int __user *)arg);
       }
@@ -606,7 +1092,9 @@ static long generic_raw_uart_ioctl(struct file *filep, unsigned int cmd, unsigne
   case TIOCOUTQ:
     if (_access_ok(VERIFY_WRITE, (void __user *)arg, sizeof(temp)))
     {
-      temp = 0;
+      spin_lock_irqsave(&instance->lock_tx, lock_flags);
+      temp = instance->tx_connection == conn ? conn->tx_buf_length - conn->tx_buf_index : 0;
+      spin_unlock_irqrestore(&instance->lock_tx, lock_flags);
       ret = __put_user(temp, (int __user *)arg);
     }
     else
@@ -658,6 +1146,11 @@ static int generic_raw_uart_acquire_sender(struct generic_raw_uart_instance *ins
   sender_idle = instance->tx_connection == NULL;
   if (sender_idle || (instance->tx_connection->priority < conn->priority))
   {
+    if (!sender_idle)
+    {
+      instance->tx_connection->tx_aborted = true;
+      generic_raw_uart_signal_tx_completed(instance->tx_connection);
+    }
     instance->tx_connection = conn;
     ret = 1;
     if (sender_idle)
@@ -686,6 +1179,90 @@ static int generic_raw_uart_send_completed(struct generic_raw_uart_instance *ins
   return ret;
 }
 
+/* Returns and clears whether the last transmission of conn was preempted */
+static bool generic_raw_uart_take_tx_aborted(struct generic_raw_uart_instance *instance, struct per_connection_data *conn)
+{
+  bool ret;
+  unsigned long lock_flags;
+
+  spin_lock_irqsave(&instance->lock_tx, lock_flags);
+  ret = conn->tx_aborted;
+  conn->tx_aborted = false;
+  spin_unlock_irqrestore(&instance->lock_tx, lock_flags);
+
+  return ret;
+}
+
+static void generic_raw_uart_dump_rx(struct generic_raw_uart_instance *instance, const unsigned char *data, size_t len)
+{
+  size_t chunk;
+
+  while (len > 0)
+  {
+    chunk = min(len, sizeof(instance->dump_rxbuf) - instance->dump_rxbuf_pos);
+    memcpy(instance->dump_rxbuf + instance->dump_rxbuf_pos, data, chunk);
+    instance->dump_rxbuf_pos += chunk;
+    data += chunk;
+    len -= chunk;
+
+    if (instance->dump_rxbuf_pos == sizeof(instance->dump_rxbuf))
+    {
+      print_hex_dump(KERN_INFO, instance->dump_rx_prefix, DUMP_PREFIX_NONE, 32, 1, instance->dump_rxbuf, sizeof(instance->dump_rxbuf), false);
+      instance->dump_rxbuf_pos = 0;
+    }
+  }
+}
+
+/* Must be called with lock_rx held */
+static void generic_raw_uart_push_rx_buf(struct generic_raw_uart_instance *instance, struct circ_buf *rxbuf, const unsigned char *data, size_t len)
+{
+  int head = rxbuf->head;
+  int tail = READ_ONCE(rxbuf->tail);
+  size_t space = CIRC_SPACE(head, tail, instance->rxbuf_size);
+  size_t len_to_end;
+
+  if (len > space)
+  {
+    instance->count_buf_overrun += len - space;
+    dev_err_ratelimited(instance->dev, "generic_raw_uart_push_rx_buf(): rx fifo full.");
+    len = space;
+  }
+
+  len_to_end = min(len, (size_t)CIRC_SPACE_TO_END(head, tail, instance->rxbuf_size));
+  memcpy(rxbuf->buf + head, data, len_to_end);
+  memcpy(rxbuf->buf, data + len_to_end, len - len_to_end);
+
+  smp_store_release(&rxbuf->head, (head + len) & (instance->rxbuf_size - 1));
+}
+
+/* Must only be called from the (single) RX path of the driver */
+static void generic_raw_uart_push_rx(struct generic_raw_uart_instance *instance, const unsigned char *data, size_t len)
+{
+  unsigned long flags;
+  int i;
+
+  if (instance->dump_traffic)
+    generic_raw_uart_dump_rx(instance, data, len);
+
+  /* lock_rx is only contended while the RX buffers are reconfigured */
+  spin_lock_irqsave(&instance->lock_rx, flags);
+
+  if (instance->rx_fanout)
+  {
+    for (i = 0; i < MAX_CONNECTIONS; i++)
+    {
+      if (instance->rx_connections[i])
+        generic_raw_uart_push_rx_buf(instance, &instance->rx_connections[i]->rxbuf, data, len);
+    }
+  }
+  else
+  {
+    generic_raw_uart_push_rx_buf(instance, &instance->rxbuf, data, len);
+  }
+
+  spin_unlock_irqrestore(&instance->lock_rx, flags);
+}
+
 void generic_raw_uart_handle_rx_char(struct generic_raw_uart *raw_uart, enum generic_raw_uart_rx_flags flags, unsigned char data)
 {
   struct generic_raw_uart_instance *instance = raw_uart->private;
@@ -711,38 +1288,27 @@ void generic_raw_uart_handle_rx_char(struct generic_raw_uart *raw_uart, enum gen
       instance->count_overrun++;
     }
 
-    if (instance->dump_traffic)
-    {
-      instance->dump_rxbuf[instance->dump_rxbuf_pos++] = data;
-      if (instance->dump_rxbuf_pos == sizeof(instance->dump_rxbuf))
-      {
-        print_hex_dump(KERN_INFO, instance->dump_rx_prefix, DUMP_PREFIX_NONE, 32, 1, instance->dump_rxbuf, sizeof(instance->dump_rxbuf), false);
-        instance->dump_rxbuf_pos = 0;
-      }
-    }
-
-    if (CIRC_SPACE(instance->rxbuf.head, instance->rxbuf.tail, CIRCBUF_SIZE))
-    {
-      instance->rxbuf.buf[instance->rxbuf.head] = data;
-      smp_wmb();
-
-      if (++(instance->rxbuf.head) >= CIRCBUF_SIZE)
-      {
-        instance->rxbuf.head = 0;
-      }
-    }
-    else
-    {
-      dev_err(instance->dev, "generic_raw_uart_handle_rx_char(): rx fifo full.");
-    }
+    generic_raw_uart_push_rx(instance, &data, 1);
   }
 }
 EXPORT_SYMBOL(generic_raw_uart_handle_rx_char);
 
+void generic_raw_uart_handle_rx_chars(struct generic_raw_uart *raw_uart, const unsigned char *data, size_t len)
+{
+  struct generic_raw_uart_instance *instance = raw_uart->private;
+
+  instance->count_rx += len;
+
+  generic_raw_uart_push_rx(instance, data, len);
+}
+EXPORT_SYMBOL(generic_raw_uart_handle_rx_chars);
+
 void generic_raw_uart_rx_completed(struct generic_raw_uart *raw_uart)
 {
   struct generic_raw_uart_instance *instance = raw_uart->private;
 
+  instance->count_rx_irq++;
+
   if (instance->dump_traffic)
   {
     print_hex_dump(KERN_INFO, instance->dump_rx_prefix, DUMP_PREFIX_NONE, 32, 1, instance->dump_rxbuf, instance->dump_rxbuf_pos, false);
@@ -756,38 +1322,65 @@ EXPORT_SYMBOL(generic_raw_uart_rx_completed);
 void generic_raw_uart_tx_queued(struct generic_raw_uart *raw_uart)
 {
   struct generic_raw_uart_instance *instance = raw_uart->private;
+  unsigned long flags;
 
-  spin_lock(&instance->lock_tx);
+  /* may also be called from DMA completion callbacks, which run with interrupts enabled */
+  spin_lock_irqsave(&instance->lock_tx, flags);
+  instance->count_tx_irq++;
   generic_raw_uart_tx_queued_unlocked(instance);
-  spin_unlock(&instance->lock_tx);
+  spin_unlock_irqrestore(&instance->lock_tx, flags);
 }
 EXPORT_SYMBOL(generic_raw_uart_tx_queued);
 
+static inline void generic_raw_uart_tx_bulk_unlocked(struct generic_raw_uart_instance *instance, int bulksize)
+{
+  if (instance->dump_traffic)
+    print_hex_dump(KERN_INFO, instance->dump_tx_prefix, DUMP_PREFIX_NONE, 32, 1, &instance->tx_connection->txbuf[instance->tx_connection->tx_buf_index], bulksize, false);
+
+  instance->driver->tx_chars(&instance->raw_uart, instance->tx_connection->txbuf, instance->tx_connection->tx_buf_index, bulksize);
+  instance->tx_connection->tx_buf_index += bulksize;
+  smp_wmb();
+#ifdef PROC_DEBUG
+  instance->count_tx += bulksize;
+#endif /*PROC_DEBUG*/
+}
+
 static inline void generic_raw_uart_tx_queued_unlocked(struct generic_raw_uart_instance *instance)
 {
   int tx_count = 0;
   int bulksize = 0;
+  int fifo_free;
 
-  while ((tx_count < instance->driver->tx_chunk_size) && (instance->driver->isready_for_tx(&instance->raw_uart)) &&
-         (instance->tx_connection != NULL) && (instance->tx_connection->tx_buf_index < instance->tx_connection->tx_buf_length))
+  if (instance->driver->tx_fifo_free != NULL)
   {
-    bulksize = min(instance->driver->tx_bulktransfer_size, (int)(instance->tx_connection->tx_buf_length - instance->tx_connection->tx_buf_index));
-
-    if (instance->dump_traffic)
-      print_hex_dump(KERN_INFO, instance->dump_tx_prefix, DUMP_PREFIX_NONE, 32, 1, &instance->tx_connection->txbuf[instance->tx_connection->tx_buf_index], bulksize, false);
+    /* query the FIFO level once and fill it in a single pass */
+    if ((instance->tx_connection != NULL) && (instance->tx_connection->tx_buf_index < instance->tx_connection->tx_buf_length))
+    {
+      fifo_free = instance->driver->tx_fifo_free(&instance->raw_uart);
 
-    instance->driver->tx_chars(&instance->raw_uart, instance->tx_connection->txbuf, instance->tx_connection->tx_buf_index, bulksize);
-    instance->tx_connection->tx_buf_index += bulksize;
-    smp_wmb();
-    tx_count += bulksize;
-#ifdef PROC_DEBUG
-    instance->count_tx += bulksize;
-#endif /*PROC_DEBUG*/
+      while ((fifo_free > 0) && (instance->tx_connection->tx_buf_index < instance->tx_connection->tx_buf_length))
+      {
+        bulksize = min3(fifo_free, instance->driver->tx_bulktransfer_size, (int)(instance->tx_connection->tx_buf_length - instance->tx_connection->tx_buf_index));
+        generic_raw_uart_tx_bulk_unlocked(instance, bulksize);
+        fifo_free -= bulksize;
+      }
+    }
+  }
+  else
+  {
+    while ((tx_count < instance->driver->tx_chunk_size) && (instance->driver->isready_for_tx(&instance->raw_uart)) &&
+           (instance->tx_connection != NULL) && (instance->tx_connection->tx_buf_index < instance->tx_connection->tx_buf_length))
+    {
+      bulksize = min(instance->driver->tx_bulktransfer_size, (int)(instance->tx_connection->tx_buf_length - instance->tx_connection->tx_buf_index));
+      generic_raw_uart_tx_bulk_unlocked(instance, bulksize);
+      tx_count += bulksize;
+    }
   }
 
   if ((instance->tx_connection != NULL) && (instance->tx_connection->tx_buf_index >= instance->tx_connection->tx_buf_length))
   {
     instance->driver->stop_tx(&instance->raw_uart);
+    generic_raw_uart_signal_tx_completed(instance->tx_connection);
     instance->tx_connection = NULL;
     smp_wmb();
     wake_up_interruptible(&instance->writeq);
@@ -806,7 +1399,16 @@ static int generic_raw_uart_proc_show(struct seq_file *m, void *v)
   seq_printf(m, "count_parity=%d\n", instance->count_parity);
   seq_printf(m, "count_frame=%d\n", instance->count_frame);
   seq_printf(m, "count_overrun=%d\n", instance->count_overrun);
-  seq_printf(m, "rxbuf_size=%d\n", CIRC_CNT(instance->rxbuf.head, instance->rxbuf.tail, CIRCBUF_SIZE));
+  seq_printf(m, "count_buf_overrun=%d\n", instance->count_buf_overrun);
+  seq_printf(m, "count_hm_frames=%d\n", instance->count_hm_frames);
+  seq_printf(m, "count_hm_frame_errors=%d\n", instance->count_hm_frame_errors);
+  seq_printf(m, "count_rx_irq=%d\n", instance->count_rx_irq);
+  seq_printf(m, "count_tx_irq=%d\n", instance->count_tx_irq);
+  seq_printf(m, "rx_irq_per_kb=%d\n", instance->count_rx ? (int)div_u64((u64)instance->count_rx_irq * 1024, instance->count_rx) : 0);
+  seq_printf(m, "tx_irq_per_kb=%d\n", instance->count_tx ? (int)div_u64((u64)instance->count_tx_irq * 1024, instance->count_tx) : 0);
+  seq_printf(m, "rxbuf_capacity=%d\n", instance->rxbuf_size);
+  seq_printf(m, "txbuf_capacity=%d\n", instance->txbuf_size);
+  seq_printf(m, "rxbuf_size=%d\n", CIRC_CNT(instance->rxbuf.head, instance->rxbuf.tail, instance->rxbuf_size));
   seq_printf(m, "rxbuf_head=%d\n", instance->rxbuf.head);
   seq_printf(m, "rxbuf_tail=%d\n", instance->rxbuf.tail);
 
@@ -939,6 +1541,124 @@ static ssize_t connection_state_show(struct device *dev, struct device_attribute
 }
 static DEVICE_ATTR_RO(connection_state);
 
+static int generic_raw_uart_parse_buf_size(const char *buf, int *size)
+{
+  unsigned int val;
+
+  if (kstrtouint(strim((char *)buf), 0, &val))
+    return -EINVAL;
+
+  if (!is_power_of_2(val) || val < MIN_BUF_SIZE || val > MAX_BUF_SIZE)
+    return -EINVAL;
+
+  *size = val;
+  return 0;
+}
+
+static ssize_t rx_buf_size_show(struct device *dev, struct device_attribute *attr, char *page)
+{
+  struct generic_raw_uart_instance *instance = dev_get_drvdata(dev);
+  return sprintf(page, "%d\n", instance->rxbuf_size);
+}
+static ssize_t rx_buf_size_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+  struct generic_raw_uart_instance *instance = dev_get_drvdata(dev);
+  unsigned long flags;
+  unsigned char *new_buf;
+  unsigned char *old_buf;
+  int size;
+  int ret;
+
+  ret = generic_raw_uart_parse_buf_size(buf, &size);
+  if (ret)
+    return ret;
+
+  new_buf = kmalloc(size, GFP_KERNEL);
+  if (!new_buf)
+    return -ENOMEM;
+
+  if (down_interruptible(&instance->sem))
+  {
+    kfree(new_buf);
+    return -ERESTARTSYS;
+  }
+
+  /* Resizing is only possible while there is no reader */
+  if (instance->open_count)
+  {
+    up(&instance->sem);
+    kfree(new_buf);
+    return -EBUSY;
+  }
+
+  spin_lock_irqsave(&instance->lock_rx, flags);
+  old_buf = instance->rxbuf.buf;
+  instance->rxbuf.buf = new_buf;
+  instance->rxbuf_size = size;
+  instance->rxbuf.head = instance->rxbuf.tail = 0;
+  spin_unlock_irqrestore(&instance->lock_rx, flags);
+
+  up(&instance->sem);
+
+  kfree(old_buf);
+
+  return count;
+}
+static DEVICE_ATTR_RW(rx_buf_size);
+
+static ssize_t tx_buf_size_show(struct device *dev, struct device_attribute *attr, char *page)
+{
+  struct generic_raw_uart_instance *instance = dev_get_drvdata(dev);
+  return sprintf(page, "%d\n", instance->txbuf_size);
+}
+static ssize_t tx_buf_size_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+  struct generic_raw_uart_instance *instance = dev_get_drvdata(dev);
+  int size;
+  int ret;
+
+  ret = generic_raw_uart_parse_buf_size(buf, &size);
+  if (ret)
+    return ret;
+
+  /* Applies to connections opened afterwards */
+  WRITE_ONCE(instance->txbuf_size, size);
+
+  return count;
+}
+static DEVICE_ATTR_RW(tx_buf_size);
+
+static ssize_t rx_fanout_show(struct device *dev, struct device_attribute *attr, char *page)
+{
+  struct generic_raw_uart_instance *instance = dev_get_drvdata(dev);
+  return sprintf(page, instance->rx_fanout ? "on" : "off");
+}
+static ssize_t rx_fanout_store(struct device *dev, struct device_attribute *attr, const char *buf, size_t count)
+{
+  struct generic_raw_uart_instance *instance = dev_get_drvdata(dev);
+  bool val;
+
+  if (kstrtobool(strim((char *)buf), &val))
+    return -EINVAL;
+
+  if (down_interruptible(&instance->sem))
+    return -ERESTARTSYS;
+
+  /* Switching is only possible while there is no connection */
+  if (instance->open_count)
+  {
+    up(&instance->sem);
+    return -EBUSY;
+  }
+
+  instance->rx_fanout = val;
+  up(&instance->sem);
+
+  dev_info(instance->dev, val ? "Enabled RX fan-out to all connections" : "Disabled RX fan-out to all connections");
+  return count;
+}
+static DEVICE_ATTR_RW(rx_fanout);
+
 static spinlock_t active_devices_lock;
 static bool active_devices[MAX_DEVICES] = {false};
 
@@ -1094,6 +1814,15 @@ struct generic_raw_uart *generic_raw_uart_probe(struct device *dev, struct raw_u
     goto failed_inst_alloc;
   }
 
+  instance->rxbuf_size = rx_buf_size;
+  instance->txbuf_size = tx_buf_size;
+  instance->rxbuf.buf = kmalloc(instance->rxbuf_size, GFP_KERNEL);
+  if (!instance->rxbuf.buf)
+  {
+    err = -ENOMEM;
+    goto failed_rxbuf_alloc;
+  }
+
   instance->raw_uart.private = instance;
   instance->raw_uart.driver_data = driver_data;
   instance->raw_uart.dev_number = dev_no;
@@ -1159,13 +1888,17 @@ struct generic_raw_uart *generic_raw_uart_probe(struct device *dev, struct raw_u
   err = sysfs_create_file(&instance->dev->kobj, &dev_attr_open_count.attr);
   err = sysfs_create_file(&instance->dev->kobj, &dev_attr_connection_state.attr);
 
+  err = sysfs_create_file(&instance->dev->kobj, &dev_attr_rx_buf_size.attr);
+  err = sysfs_create_file(&instance->dev->kobj, &dev_attr_tx_buf_size.attr);
+  err = sysfs_create_file(&instance->dev->kobj, &dev_attr_rx_fanout.attr);
+
   sema_init(&instance->sem, 1);
   spin_lock_init(&instance->lock_tx);
+  spin_lock_init(&instance->lock_rx);
+  mutex_init(&instance->rx_read_lock);
   init_waitqueue_head(&instance->readq);
   init_waitqueue_head(&instance->writeq);
 
-  instance->rxbuf.buf = kmalloc(CIRCBUF_SIZE, GFP_KERNEL);
-
 #ifdef PROC_DEBUG
   proc_create_data(dev_name(instance->dev), 0444, NULL, &generic_raw_uart_proc_fops, instance);
 #endif
@@ -1183,6 +1916,8 @@ failed_device_create:
   cdev_del(&instance->cdev);
 failed_cdev_add:
   unregister_chrdev_region(instance->devid, 1);
+  kfree(instance->rxbuf.buf);
+failed_rxbuf_alloc:
   kfree(instance);
 failed_inst_alloc:
 failed_probe_rtc:
@@ -1225,6 +1960,10 @@ int generic_raw_uart_remove(struct generic_raw_uart *raw_uart)
   sysfs_remove_file(&instance->dev->kobj, &dev_attr_open_count.attr);
   sysfs_remove_file(&instance->dev->kobj, &dev_attr_connection_state.attr);
 
+  sysfs_remove_file(&instance->dev->kobj, &dev_attr_rx_buf_size.attr);
+  sysfs_remove_file(&instance->dev->kobj, &dev_attr_tx_buf_size.attr);
+  sysfs_remove_file(&instance->dev->kobj, &dev_attr_rx_fanout.attr);
+
   if (instance->reset_pin != 0)
   {
     gpio_free(instance->reset_pin);
@@ -1237,6 +1976,7 @@ int generic_raw_uart_remove(struct generic_raw_uart *raw_uart)
   active_devices[instance->raw_uart.dev_number] = false;
   spin_unlock_irqrestore(&active_devices_lock, flags);
 
+  kfree(instance->rxbuf.buf);
   kfree(instance);
 
   return 0;
@@ -1286,6 +2026,29 @@ static const struct kernel_param_ops generic_raw_uart_set_dummy_rx8130_loader_pa
 module_param_cb(load_dummy_rx8130_module, &generic_raw_uart_set_dummy_rx8130_loader_param_ops, NULL, S_IWUSR);
 MODULE_PARM_DESC(load_dummy_rx8130_module, "Loads the dummy_rx8130 module");
 
+static int generic_raw_uart_set_buf_size(const char *val, const struct kernel_param *kp)
+{
+  unsigned int size;
+
+  if (kstrtouint(val, 0, &size) || !is_power_of_2(size) || size < MIN_BUF_SIZE || size > MAX_BUF_SIZE)
+  {
+    return -EINVAL;
+  }
+
+  *((int *)kp->arg) = size;
+  return 0;
+}
+
+static const struct kernel_param_ops generic_raw_uart_buf_size_param_ops = {
+    .set = generic_raw_uart_set_buf_size,
+    .get = param_get_int,
+};
+
+module_param_cb(rx_buf_size, &generic_raw_uart_buf_size_param_ops, &rx_buf_size, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(rx_buf_size, "Default size of the RX buffer of new devices (power of two, 256-65536)");
+module_param_cb(tx_buf_size, &generic_raw_uart_buf_size_param_ops, &tx_buf_size, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(tx_buf_size, "Default size of the per connection TX buffer of new devices (power of two, 256-65536)");
+
 struct sdesc {
   struct shash_desc shash;
   char ctx[];
@@ -1355,7 +2118,7 @@ EXPORT_SYMBOL(generic_raw_uart_verify_dkey);
 
 MODULE_ALIAS("platform:generic-raw-uart");
 MODULE_LICENSE("GPL");
-MODULE_VERSION("1.31");
+MODULE_VERSION("1.37");
 MODULE_DESCRIPTION("generic raw uart driver for communication of debmatic and piVCCU with the HM-MOD-RPI-PCB and RPI-RF-MOD radio modules");
 MODULE_AUTHOR("Alexander Reinert <alex@areinert.de>");
 
@@ -60,6 +60,7 @@ struct raw_uart_driver
 
   void (*init_tx)(struct generic_raw_uart *raw_uart);
   bool (*isready_for_tx)(struct generic_raw_uart *raw_uart);
+  int (*tx_fifo_free)(struct generic_raw_uart *raw_uart); /* optional, number of bytes which can be written to the TX FIFO at once */
   void (*tx_chars)(struct generic_raw_uart *raw_uart, unsigned char *chr, int index, int len);
   void (*stop_tx)(struct generic_raw_uart *raw_uart);
 
@@ -89,6 +90,7 @@ extern int generic_raw_uart_set_connection_state(struct generic_raw_uart *raw_ua
 extern int generic_raw_uart_remove(struct generic_raw_uart *raw_uart);
 extern void generic_raw_uart_tx_queued(struct generic_raw_uart *raw_uart);
 extern void generic_raw_uart_handle_rx_char(struct generic_raw_uart *raw_uart, enum generic_raw_uart_rx_flags, unsigned char);
+extern void generic_raw_uart_handle_rx_chars(struct generic_raw_uart *raw_uart, const unsigned char *data, size_t len);
 extern void generic_raw_uart_rx_completed(struct generic_raw_uart *raw_uart);
 
 extern bool generic_raw_uart_verify_dkey(struct device *dev, unsigned char *dkey, int dkey_len, unsigned char *skey, uint32_t *pkey, int bytes);
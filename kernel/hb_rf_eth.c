@@ -35,7 +35,9 @@
 #endif
 #include <linux/spinlock.h>
 #include <linux/circ_buf.h>
+#include <linux/hrtimer.h>
 #include "generic_raw_uart.h"
+#include "hm_crc.h"
 
 #include "stack_protector.include"
 
@@ -46,6 +48,8 @@
 
 #define BUFFER_SIZE 1500
 
+#define KEEPALIVE_INTERVAL_MS 1000
+
 static short int autoreconnect = 1;
 
 static struct gpio_chip gc = {0};
@@ -56,6 +60,9 @@ static struct socket *_sock = NULL;
 static struct sockaddr_in remote = {0};
 static atomic_t msg_cnt = ATOMIC_INIT(0);
 static struct task_struct *k_recv_thread = NULL;
+static wait_queue_head_t recv_wq;
+static atomic_t recv_data_ready = ATOMIC_INIT(0);
+static void (*sock_def_data_ready)(struct sock *sk) = NULL;
 
 static struct generic_raw_uart *raw_uart = NULL;
 static struct class *class = NULL;
@@ -82,31 +89,12 @@ static struct send_msg_queue_t *send_msg_queue;
 static struct task_struct *k_send_thread = NULL;
 static spinlock_t queue_write_lock;
 static wait_queue_head_t queue_wq;
+static struct hrtimer keepalive_timer;
+static atomic_t keepalive_due = ATOMIC_INIT(0);
 
-static uint16_t hb_rf_eth_calc_crc(unsigned char *buf, size_t len)
-{
-  uint16_t crc = 0xd77f;
-  int i;
-
-  while (len--)
-  {
-    crc ^= *buf++ << 8;
-    for (i = 0; i < 8; i++)
-    {
-      if (crc & 0x8000)
-      {
-        crc <<= 1;
-        crc ^= 0x8005;
-      }
-      else
-      {
-        crc <<= 1;
-      }
-    }
-  }
-
-  return crc;
-}
+static unsigned long count_tx_chunks = 0;  /* UART data chunks queued by the generic layer */
+static unsigned long count_tx_frames = 0;  /* HM frames (frame delimiters) in the UART data */
+static unsigned long count_tx_packets = 0; /* UDP packets sent with UART data */
 
 static void hb_rf_eth_queue_msg(char cmd, char *buffer, size_t len)
 {
@@ -140,7 +128,7 @@ static void hb_rf_eth_queue_msg(char cmd, char *buffer, size_t len)
   spin_unlock(&queue_write_lock);
 }
 
-static int hb_rf_eth_recv_packet(struct socket *sock, char *buffer, size_t buffer_size)
+static int hb_rf_eth_recv_packet(struct socket *sock, char *buffer, size_t buffer_size, int flags)
 {
   struct kvec vec = {0};
   struct msghdr msg = {0};
@@ -152,7 +140,7 @@ static int hb_rf_eth_recv_packet(struct socket *sock, char *buffer, size_t buffe
   vec.iov_len = buffer_size;
   vec.iov_base = buffer;
 
-  len = kernel_recvmsg(sock, &msg, &vec, 1, buffer_size, 0);
+  len = kernel_recvmsg(sock, &msg, &vec, 1, buffer_size, flags);
 
   if (len > 0)
   {
@@ -161,7 +149,7 @@ static int hb_rf_eth_recv_packet(struct socket *sock, char *buffer, size_t buffe
       dev_err_ratelimited(dev, "Received to small UDP packet\n");
       return -EPROTO;
     }
-    if (*((uint16_t *)(buffer + len - 2)) != (uint16_t)(htons(hb_rf_eth_calc_crc(buffer, len - 2))))
+    if (*((uint16_t *)(buffer + len - 2)) != (uint16_t)(htons(hm_crc(buffer, len - 2))))
     {
       dev_err_ratelimited(dev, "Received UDP packet with invalid checksum\n");
       return -EPROTO;
@@ -175,6 +163,24 @@ static int hb_rf_eth_recv_packet(struct socket *sock, char *buffer, size_t buffe
   return len;
 }
 
+static void hb_rf_eth_data_ready(struct sock *sk)
+{
+  atomic_set(&recv_data_ready, 1);
+  wake_up_interruptible(&recv_wq);
+
+  if (sock_def_data_ready)
+    sock_def_data_ready(sk);
+}
+
+/* wake up the receiver thread on incoming datagrams instead of polling the socket */
+static void hb_rf_eth_set_data_ready_callback(struct socket *sock)
+{
+  write_lock_bh(&sock->sk->sk_callback_lock);
+  sock_def_data_ready = sock->sk->sk_data_ready;
+  sock->sk->sk_data_ready = hb_rf_eth_data_ready;
+  write_unlock_bh(&sock->sk->sk_callback_lock);
+}
+
 static void hb_rf_eth_set_timeout(struct socket *sock)
 {
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 1, 0)
@@ -202,7 +208,7 @@ static void hb_rf_eth_send_msg(struct socket *sock, char *buffer, size_t len)
   int err;
 
   *((uint8_t *)(buffer + 1)) = (uint8_t)(atomic_inc_return(&msg_cnt));
-  *((uint16_t *)(buffer + len - 2)) = (uint16_t)(htons(hb_rf_eth_calc_crc(buffer, len - 2)));
+  *((uint16_t *)(buffer + len - 2)) = (uint16_t)(htons(hm_crc(buffer, len - 2)));
 
   if (sock)
   {
@@ -267,7 +273,7 @@ static int hb_rf_eth_try_connect(char endpointIdentifier)
     timeout = jiffies + msecs_to_jiffies(50);
     while (time_before(jiffies, timeout))
     {
-      len = hb_rf_eth_recv_packet(sock, recv_buffer, BUFFER_SIZE);
+      len = hb_rf_eth_recv_packet(sock, recv_buffer, BUFFER_SIZE, 0);
       if (len == 7)
       {
         if (recv_buffer[0] == 0 && recv_buffer[2] == HB_RF_ETH_PROTOCOL_VERSION && recv_buffer[3] == buffer[1])
@@ -287,6 +293,8 @@ static int hb_rf_eth_try_connect(char endpointIdentifier)
     }
   }
 
+  hb_rf_eth_set_data_ready_callback(sock);
+
   _sock = sock;
   sysfs_notify(&dev->kobj, NULL, "is_connected");
   generic_raw_uart_set_connection_state(raw_uart, true);
@@ -315,41 +323,106 @@ static bool is_queue_filled(int *head, int *tail)
   return CIRC_CNT(*head, *tail, QUEUE_LENGTH) >= 1;
 }
 
+static bool is_send_pending(int *head, int *tail)
+{
+  return is_queue_filled(head, tail) || atomic_read(&keepalive_due) || kthread_should_stop();
+}
+
+static enum hrtimer_restart hb_rf_eth_keepalive_timer_fn(struct hrtimer *timer)
+{
+  atomic_set(&keepalive_due, 1);
+  wake_up(&queue_wq);
+
+  hrtimer_forward_now(timer, ms_to_ktime(KEEPALIVE_INTERVAL_MS));
+  return HRTIMER_RESTART;
+}
+
+/* sends consecutive queued UART data entries as one packet, returns the new tail */
+static int hb_rf_eth_send_uart_data(char *buffer, int head, int tail)
+{
+  struct send_msg_queue_entry *entry = send_msg_queue->entries + tail;
+  size_t len = 0;
+
+  buffer[0] = 7;
+  buffer[1] = 0;
+
+  do
+  {
+    memcpy(buffer + 2 + len, entry->buffer + 2, entry->len - 4);
+    len += entry->len - 4;
+
+    tail = (tail + 1) & (QUEUE_LENGTH - 1);
+    entry = send_msg_queue->entries + tail;
+  } while (tail != head && entry->buffer[0] == 7 && len + entry->len - 4 <= TX_CHUNK_SIZE);
+
+  hb_rf_eth_send_msg(_sock, buffer, len + 4);
+  count_tx_packets++;
+
+  return tail;
+}
+
 static int hb_rf_eth_send_threadproc(void *data)
 {
   struct send_msg_queue_entry *entry;
-  char buffer[4] = {2, 0, 0, 0};
+  char keepalive[4] = {2, 0, 0, 0};
+  char *buffer;
   int head;
   int tail;
-  unsigned long nextKeepAliveSentOut = jiffies;
 
   hb_rf_eth_set_high_prio();
 
+  buffer = kmalloc(BUFFER_SIZE, GFP_KERNEL);
+
+  atomic_set(&keepalive_due, 1);
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+  hrtimer_setup(&keepalive_timer, hb_rf_eth_keepalive_timer_fn, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+#else
+  hrtimer_init(&keepalive_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+  keepalive_timer.function = hb_rf_eth_keepalive_timer_fn;
+#endif
+  hrtimer_start(&keepalive_timer, ms_to_ktime(KEEPALIVE_INTERVAL_MS), HRTIMER_MODE_REL);
+
   while (!kthread_should_stop())
   {
-    if (is_queue_filled(&head, &tail) || wait_event_interruptible_timeout(queue_wq, is_queue_filled(&head, &tail), msecs_to_jiffies(100)) > 0)
+    wait_event_interruptible(queue_wq, is_send_pending(&head, &tail));
+
+    while (is_queue_filled(&head, &tail))
     {
       entry = send_msg_queue->entries + tail;
 
-      if (entry->buffer[0] == 3)
+      if (entry->buffer[0] == 7 && buffer)
       {
-        mb();
-        entry->buffer[2] = gpio_value;
+        tail = hb_rf_eth_send_uart_data(buffer, head, tail);
       }
+      else
+      {
+        if (entry->buffer[0] == 3)
+        {
+          mb();
+          entry->buffer[2] = gpio_value;
+        }
+        else if (entry->buffer[0] == 7)
+        {
+          count_tx_packets++;
+        }
 
-      hb_rf_eth_send_msg(_sock, entry->buffer, entry->len);
+        hb_rf_eth_send_msg(_sock, entry->buffer, entry->len);
+
+        tail = (tail + 1) & (QUEUE_LENGTH - 1);
+      }
 
-      tail = (tail + 1) & (QUEUE_LENGTH - 1);
       smp_store_release(&send_msg_queue->tail, tail);
     }
 
-    if (time_after(jiffies, nextKeepAliveSentOut))
+    if (atomic_xchg(&keepalive_due, 0))
     {
-      nextKeepAliveSentOut = jiffies + msecs_to_jiffies(1000);
-      hb_rf_eth_send_msg(_sock, buffer, 4);
+      hb_rf_eth_send_msg(_sock, keepalive, 4);
     }
   }
 
+  hrtimer_cancel(&keepalive_timer);
+  kfree(buffer);
+
   return 0;
 }
 
@@ -357,7 +430,8 @@ static int hb_rf_eth_recv_threadproc(void *data)
 {
   char *buffer;
   int len;
-  int i;
+  bool rx_data;
+  long timeout;
   unsigned long lastReceivedKeepAlive = jiffies;
 
   hb_rf_eth_set_high_prio();
@@ -366,9 +440,20 @@ static int hb_rf_eth_recv_threadproc(void *data)
 
   while (!kthread_should_stop())
   {
-    len = hb_rf_eth_recv_packet(_sock, buffer, BUFFER_SIZE);
-    if (len >= 4)
+    /* reset before draining, so a datagram arriving meanwhile triggers another pass */
+    atomic_set(&recv_data_ready, 0);
+    rx_data = false;
+
+    while (_sock != NULL)
     {
+      len = hb_rf_eth_recv_packet(_sock, buffer, BUFFER_SIZE, MSG_DONTWAIT);
+      if (len == -EPROTO)
+        continue;
+      if (len < 0)
+        break;
+      if (len < 4)
+        continue;
+
       switch (buffer[0])
       {
       case 2:
@@ -376,11 +461,8 @@ static int hb_rf_eth_recv_threadproc(void *data)
         break;
       case 7:
         lastReceivedKeepAlive = jiffies;
-        for (i = 2; i < len - 2; i++)
-        {
-          generic_raw_uart_handle_rx_char(raw_uart, GENERIC_RAW_UART_RX_STATE_NONE, (unsigned char)buffer[i]);
-        }
-        generic_raw_uart_rx_completed(raw_uart);
+        generic_raw_uart_handle_rx_chars(raw_uart, (unsigned char *)buffer + 2, len - 4);
+        rx_data = true;
         break;
       default:
         print_hex_dump(KERN_INFO, "Received unknown UDP packet: ", DUMP_PREFIX_NONE, 16, 1, buffer, len, false);
@@ -388,6 +470,11 @@ static int hb_rf_eth_recv_threadproc(void *data)
       }
     }
 
+    if (rx_data)
+    {
+      generic_raw_uart_rx_completed(raw_uart);
+    }
+
     if (time_after(jiffies, lastReceivedKeepAlive + msecs_to_jiffies(5000)))
     {
       dev_err(dev, "Did not receive any packet in the last 5 seconds, terminating connection.\n");
@@ -416,6 +503,10 @@ static int hb_rf_eth_recv_threadproc(void *data)
         goto exit;
       }
     }
+
+    /* sleep until the next datagram arrives or the keep alive timeout expires */
+    timeout = (long)(lastReceivedKeepAlive + msecs_to_jiffies(5000) - jiffies);
+    wait_event_interruptible_timeout(recv_wq, atomic_read(&recv_data_ready) || kthread_should_stop(), max(timeout, 1L));
   }
 
 exit:
@@ -642,6 +733,16 @@ static bool hb_rf_eth_isready_for_tx(struct generic_raw_uart *raw_uart)
 
 static void hb_rf_eth_tx_chars(struct generic_raw_uart *raw_uart, unsigned char *chr, int index, int len)
 {
+  unsigned char *pos = chr + index;
+  unsigned char *end = chr + index + len;
+
+  count_tx_chunks++;
+  while ((pos = memchr(pos, 0xfd, end - pos)) != NULL)
+  {
+    count_tx_frames++;
+    pos++;
+  }
+
   hb_rf_eth_queue_msg(7, chr + index, len);
 }
 
@@ -710,6 +811,35 @@ static ssize_t is_connected_show(struct device *dev, struct device_attribute *at
 }
 static DEVICE_ATTR_RO(is_connected);
 
+static ssize_t tx_chunks_show(struct device *dev, struct device_attribute *attr, char *page)
+{
+  return sprintf(page, "%lu\n", READ_ONCE(count_tx_chunks));
+}
+static DEVICE_ATTR_RO(tx_chunks);
+
+static ssize_t tx_frames_show(struct device *dev, struct device_attribute *attr, char *page)
+{
+  return sprintf(page, "%lu\n", READ_ONCE(count_tx_frames));
+}
+static DEVICE_ATTR_RO(tx_frames);
+
+static ssize_t tx_packets_show(struct device *dev, struct device_attribute *attr, char *page)
+{
+  return sprintf(page, "%lu\n", READ_ONCE(count_tx_packets));
+}
+static DEVICE_ATTR_RO(tx_packets);
+
+static struct attribute *hb_rf_eth_tx_stats_attrs[] = {
+    &dev_attr_tx_chunks.attr,
+    &dev_attr_tx_frames.attr,
+    &dev_attr_tx_packets.attr,
+    NULL,
+};
+
+static const struct attribute_group hb_rf_eth_tx_stats_group = {
+    .attrs = hb_rf_eth_tx_stats_attrs,
+};
+
 static const char *hb_rf_eth_gpio_names[3] = { "HB-RF-ETH HM_RED", "HB-RF-ETH HM_GREEN", "HB-RF-ETH HM_BLUE" };
 
 static int __init hb_rf_eth_init(void)
@@ -720,6 +850,7 @@ static int __init hb_rf_eth_init(void)
 
   spin_lock_init(&queue_write_lock);
   init_waitqueue_head(&queue_wq);
+  init_waitqueue_head(&recv_wq);
 
   send_msg_queue = kzalloc(sizeof(struct send_msg_queue_t), GFP_KERNEL);
   send_msg_queue->entries = kcalloc(QUEUE_LENGTH, sizeof(struct send_msg_queue_entry), GFP_KERNEL);
@@ -783,6 +914,10 @@ static int __init hb_rf_eth_init(void)
   err = sysfs_create_file(&dev->kobj, &dev_attr_connect.attr);
     dev_info(dev, "failed creating connect sysfs file: %d\n", err);
 
+  err = sysfs_create_group(&dev->kobj, &hb_rf_eth_tx_stats_group);
+  if (err)
+    dev_info(dev, "failed creating tx statistics sysfs files: %d\n", err);
+
   return 0;
 
 failed_raw_uart_probe:
@@ -802,6 +937,7 @@ static void __exit hb_rf_eth_exit(void)
 
   sysfs_remove_file(&dev->kobj, &dev_attr_is_connected.attr);
   sysfs_remove_file(&dev->kobj, &dev_attr_connect.attr);
+  sysfs_remove_group(&dev->kobj, &hb_rf_eth_tx_stats_group);
 
   gpiochip_remove(&gc);
 
@@ -841,5 +977,5 @@ module_exit(hb_rf_eth_exit);
 
 MODULE_AUTHOR("Alexander Reinert <alex@areinert.de>");
 MODULE_DESCRIPTION("HB-RF-ETH raw uart driver");
-MODULE_VERSION("1.23");
+MODULE_VERSION("1.24");
 MODULE_LICENSE("GPL");
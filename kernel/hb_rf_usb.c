@@ -70,9 +70,11 @@
 #define FTDI_SIO_BITMODE_RESET 0x00
 #define FTDI_SIO_BITMODE_CBUS 0x20
 
-#define TX_CHUNK_SIZE 11
+#define WRITE_BUFFER_SIZE 4096 /* a whole HM frame is sent with a single URB */
 
-#define BUFFER_SIZE 256
+#define READ_BUFFER_SIZE 1024
+#define MAX_READ_URBS 16
+#define DEFAULT_READ_URBS 4
 
 struct hb_rf_usb_port_s
 {
@@ -83,8 +85,11 @@ struct hb_rf_usb_port_s
   bool is_in_tx;
   spinlock_t is_in_tx_lock;
 
-  struct urb *read_urb;
-  unsigned char *read_buffer;
+  struct urb *read_urbs[MAX_READ_URBS];
+  unsigned char *read_buffers[MAX_READ_URBS];
+  int read_urb_count;
+  struct usb_anchor read_anchor; /* submitted read URBs */
+  int read_maxpacket; /* every packet of the bulk in endpoint starts with two status bytes */
 
   struct usb_device *udev;
   struct usb_interface *iface;
@@ -104,6 +109,8 @@ static struct usb_device_id usbid[] = {
 
 MODULE_DEVICE_TABLE(usb, usbid);
 
+static int read_urbs = DEFAULT_READ_URBS;
+
 static void hb_rf_usb_set_gpio_on_device_completion(struct urb *urb)
 {
   kfree(urb->setup_packet);
@@ -241,6 +248,7 @@ static void hb_rf_usb_init_uart(struct hb_rf_usb_port_s *port)
   struct usb_host_interface *iface_desc;
   struct usb_endpoint_descriptor *epd;
   int i;
+  int j;
 
   // reset uart
   usb_control_msg(port->udev, usb_sndctrlpipe(port->udev, 0), FTDI_SIO_RESET_REQUEST, FTDI_SIO_RESET_REQUEST_TYPE, FTDI_SIO_RESET_SIO, 0, NULL, 0, WDR_TIMEOUT);
@@ -266,27 +274,28 @@ static void hb_rf_usb_init_uart(struct hb_rf_usb_port_s *port)
 
     if (usb_endpoint_is_bulk_in(epd))
     {
-      port->read_urb = usb_alloc_urb(0, GFP_KERNEL);
-      port->read_buffer = kmalloc(BUFFER_SIZE, GFP_KERNEL);
-      usb_fill_bulk_urb(port->read_urb, port->udev, usb_rcvbulkpipe(port->udev, epd->bEndpointAddress), port->read_buffer, BUFFER_SIZE, hb_rf_usb_process_read_urb, port);
+      port->read_urb_count = clamp(read_urbs, 1, MAX_READ_URBS);
+      for (j = 0; j < port->read_urb_count; j++)
+      {
+        port->read_urbs[j] = usb_alloc_urb(0, GFP_KERNEL);
+        port->read_buffers[j] = kmalloc(READ_BUFFER_SIZE, GFP_KERNEL);
+        usb_fill_bulk_urb(port->read_urbs[j], port->udev, usb_rcvbulkpipe(port->udev, epd->bEndpointAddress), port->read_buffers[j], READ_BUFFER_SIZE, hb_rf_usb_process_read_urb, port);
+      }
+      port->read_maxpacket = usb_endpoint_maxp(epd);
     }
     else if (usb_endpoint_is_bulk_out(epd))
     {
       port->write_urb = usb_alloc_urb(0, GFP_KERNEL);
-      port->write_buffer = kmalloc(BUFFER_SIZE, GFP_KERNEL);
-      usb_fill_bulk_urb(port->write_urb, port->udev, usb_sndbulkpipe(port->udev, epd->bEndpointAddress), port->write_buffer, BUFFER_SIZE, hb_rf_usb_process_write_urb, port);
+      port->write_buffer = kmalloc(WRITE_BUFFER_SIZE, GFP_KERNEL);
+      usb_fill_bulk_urb(port->write_urb, port->udev, usb_sndbulkpipe(port->udev, epd->bEndpointAddress), port->write_buffer, WRITE_BUFFER_SIZE, hb_rf_usb_process_write_urb, port);
     }
   }
 }
 
-static void hb_rf_usb_process_read_urb(struct urb *urb)
+static void hb_rf_usb_process_read_packet(struct hb_rf_usb_port_s *port, unsigned char *data, int len)
 {
-  struct hb_rf_usb_port_s *port = urb->context;
-
   enum generic_raw_uart_rx_flags flags = GENERIC_RAW_UART_RX_STATE_NONE;
-  char *data = (char *)urb->transfer_buffer;
   int status = data[1];
-  int i;
 
   /* Error handling */
   if (status & FTDI_RS_BI)
@@ -309,19 +318,58 @@ static void hb_rf_usb_process_read_urb(struct urb *urb)
     }
   }
 
-  if (urb->actual_length > 2)
+  data += 2;
+  len -= 2;
+
+  if (len <= 0)
+  {
+    return;
+  }
+
+  /* the error flags belong to the first byte of the packet */
+  if (flags != GENERIC_RAW_UART_RX_STATE_NONE)
+  {
+    generic_raw_uart_handle_rx_char(port->raw_uart, flags, data[0]);
+    data++;
+    len--;
+  }
+
+  if (len > 0)
+  {
+    generic_raw_uart_handle_rx_chars(port->raw_uart, data, len);
+  }
+}
+
+static void hb_rf_usb_submit_read_urb(struct hb_rf_usb_port_s *port, struct urb *urb, gfp_t mem_flags)
+{
+  usb_anchor_urb(urb, &port->read_anchor);
+  if (usb_submit_urb(urb, mem_flags))
+  {
+    usb_unanchor_urb(urb);
+  }
+}
+
+static void hb_rf_usb_process_read_urb(struct urb *urb)
+{
+  struct hb_rf_usb_port_s *port = urb->context;
+
+  unsigned char *data = (unsigned char *)urb->transfer_buffer;
+  int i;
+
+  /* URB was killed or the device is gone, do not resubmit */
+  if (urb->status == -ENOENT || urb->status == -ECONNRESET || urb->status == -ESHUTDOWN)
   {
-    generic_raw_uart_handle_rx_char(port->raw_uart, flags, (unsigned char)data[2]);
+    return;
   }
 
-  for (i = 3; i < urb->actual_length; i++)
+  for (i = 0; i + 2 <= urb->actual_length; i += port->read_maxpacket)
   {
-    generic_raw_uart_handle_rx_char(port->raw_uart, GENERIC_RAW_UART_RX_STATE_NONE, (unsigned char)data[i]);
+    hb_rf_usb_process_read_packet(port, data + i, min(port->read_maxpacket, (int)urb->actual_length - i));
   }
 
   generic_raw_uart_rx_completed(port->raw_uart);
 
-  usb_submit_urb(port->read_urb, GFP_ATOMIC);
+  hb_rf_usb_submit_read_urb(port, urb, GFP_ATOMIC);
 }
 
 static void hb_rf_usb_process_write_urb(struct urb *urb)
@@ -339,10 +387,14 @@ static void hb_rf_usb_process_write_urb(struct urb *urb)
 static int hb_rf_usb_start_connection(struct generic_raw_uart *raw_uart)
 {
   struct hb_rf_usb_port_s *port = raw_uart->driver_data;
+  int i;
 
   kref_get(&port->kref);
 
-  usb_submit_urb(port->read_urb, GFP_KERNEL);
+  for (i = 0; i < port->read_urb_count; i++)
+  {
+    hb_rf_usb_submit_read_urb(port, port->read_urbs[i], GFP_KERNEL);
+  }
 
   return 0;
 }
@@ -352,7 +404,7 @@ static void hb_rf_usb_stop_connection(struct generic_raw_uart *raw_uart)
   struct hb_rf_usb_port_s *port = raw_uart->driver_data;
 
   usb_kill_urb(port->write_urb);
-  usb_kill_urb(port->read_urb);
+  usb_kill_anchored_urbs(&port->read_anchor);
 
   kref_put(&port->kref, hb_rf_usb_delete);
 }
@@ -459,8 +511,8 @@ static struct raw_uart_driver hb_rf_usb = {
     .tx_chars = hb_rf_usb_tx_chars,
     .stop_tx = hb_rf_usb_stop_tx,
     .get_device_type = hb_rf_usb_get_device_type,
-    .tx_chunk_size = TX_CHUNK_SIZE,
-    .tx_bulktransfer_size = TX_CHUNK_SIZE,
+    .tx_chunk_size = WRITE_BUFFER_SIZE,
+    .tx_bulktransfer_size = WRITE_BUFFER_SIZE,
 };
 
 static const char *hb_rf_usb_gpio_names[3] = { "HB-RF-USB B_LED", "HB-RF-USB G_LED", "HB-RF-USB R_LED" };
@@ -545,6 +597,7 @@ static int hb_rf_usb_probe(struct usb_interface *interface, const struct usb_dev
   port->iface = usb_get_intf(interface);
 
   spin_lock_init(&port->is_in_tx_lock);
+  init_usb_anchor(&port->read_anchor);
   spin_lock_init(&port->gpio_lock);
 
   port->gc.label = "hb-rf-usb-gpio";
@@ -584,7 +637,7 @@ static void hb_rf_usb_disconnect(struct usb_interface *interface)
   struct hb_rf_usb_port_s *port = usb_get_intfdata(interface);
 
   usb_kill_urb(port->write_urb);
-  usb_kill_urb(port->read_urb);
+  usb_kill_anchored_urbs(&port->read_anchor);
 
   gpiochip_remove(&port->gc);
 
@@ -596,13 +649,17 @@ static void hb_rf_usb_disconnect(struct usb_interface *interface)
 static void hb_rf_usb_delete(struct kref *kref)
 {
   struct hb_rf_usb_port_s *port = container_of(kref, struct hb_rf_usb_port_s, kref);
+  int i;
 
   generic_raw_uart_remove(port->raw_uart);
 
   usb_free_urb(port->write_urb);
   kfree(port->write_buffer);
-  usb_free_urb(port->read_urb);
-  kfree(port->read_buffer);
+  for (i = 0; i < port->read_urb_count; i++)
+  {
+    usb_free_urb(port->read_urbs[i]);
+    kfree(port->read_buffers[i]);
+  }
 
   port->gpio_value = 0;
   hb_rf_usb_set_bitmode(port, FTDI_SIO_BITMODE_RESET);
@@ -640,6 +697,9 @@ static void __exit hb_rf_usb_exit(void)
 module_init(hb_rf_usb_init);
 module_exit(hb_rf_usb_exit);
 
+module_param(read_urbs, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(read_urbs, "Number of read URBs kept submitted per device (1-16), applied to newly connected devices");
+
 MODULE_LICENSE("GPL");
 MODULE_VERSION("1.16");
 MODULE_DESCRIPTION("HB-RF-USB raw uart driver for communication of debmatic and piVCCU with the HM-MOD-RPI-PCB and RPI-RF-MOD radio modules");
@@ -27,9 +27,11 @@
 
 #include "stack_protector.include"
 
-#define TX_CHUNK_SIZE 11
+#define WRITE_BUFFER_SIZE 4096 /* a whole HM frame is sent with a single URB */
 
-#define BUFFER_SIZE 256
+#define READ_BUFFER_SIZE 1024
+#define MAX_READ_URBS 16
+#define DEFAULT_READ_URBS 4
 
 #define REQTYPE_HOST_TO_INTERFACE 0x41
 #define REQTYPE_INTERFACE_TO_HOST 0xc1
@@ -78,8 +80,10 @@ struct hb_rf_usb_2_port_s
   bool is_in_tx;
   spinlock_t is_in_tx_lock;
 
-  struct urb *read_urb;
-  unsigned char *read_buffer;
+  struct urb *read_urbs[MAX_READ_URBS];
+  unsigned char *read_buffers[MAX_READ_URBS];
+  int read_urb_count;
+  struct usb_anchor read_anchor; /* submitted read URBs */
 
   struct usb_device *udev;
   struct usb_interface *iface;
@@ -102,6 +106,8 @@ static struct usb_device_id usbid[] = {
 
 MODULE_DEVICE_TABLE(usb, usbid);
 
+static int read_urbs = DEFAULT_READ_URBS;
+
 static void hb_rf_usb_2_set_gpio_on_device_completion(struct urb *urb)
 {
   kfree(urb->setup_packet);
@@ -224,6 +230,7 @@ static void hb_rf_usb_2_init_uart(struct hb_rf_usb_2_port_s *port)
   struct usb_host_interface *iface_desc;
   struct usb_endpoint_descriptor *epd;
   int i;
+  int j;
   u32 baudrate;
   void *dmabuf;
 
@@ -243,82 +250,110 @@ static void hb_rf_usb_2_init_uart(struct hb_rf_usb_2_port_s *port)
 
     if (usb_endpoint_is_bulk_in(epd))
     {
-      port->read_urb = usb_alloc_urb(0, GFP_KERNEL);
-      port->read_buffer = kmalloc(BUFFER_SIZE, GFP_KERNEL);
-      usb_fill_bulk_urb(port->read_urb, port->udev, usb_rcvbulkpipe(port->udev, epd->bEndpointAddress), port->read_buffer, BUFFER_SIZE, hb_rf_usb_2_process_read_urb, port);
+      port->read_urb_count = clamp(read_urbs, 1, MAX_READ_URBS);
+      for (j = 0; j < port->read_urb_count; j++)
+      {
+        port->read_urbs[j] = usb_alloc_urb(0, GFP_KERNEL);
+        port->read_buffers[j] = kmalloc(READ_BUFFER_SIZE, GFP_KERNEL);
+        usb_fill_bulk_urb(port->read_urbs[j], port->udev, usb_rcvbulkpipe(port->udev, epd->bEndpointAddress), port->read_buffers[j], READ_BUFFER_SIZE, hb_rf_usb_2_process_read_urb, port);
+      }
     }
     else if (usb_endpoint_is_bulk_out(epd))
     {
       port->write_urb = usb_alloc_urb(0, GFP_KERNEL);
-      port->write_buffer = kmalloc(BUFFER_SIZE, GFP_KERNEL);
-      usb_fill_bulk_urb(port->write_urb, port->udev, usb_sndbulkpipe(port->udev, epd->bEndpointAddress), port->write_buffer, BUFFER_SIZE, hb_rf_usb_2_process_write_urb, port);
+      port->write_buffer = kmalloc(WRITE_BUFFER_SIZE, GFP_KERNEL);
+      usb_fill_bulk_urb(port->write_urb, port->udev, usb_sndbulkpipe(port->udev, epd->bEndpointAddress), port->write_buffer, WRITE_BUFFER_SIZE, hb_rf_usb_2_process_write_urb, port);
     }
   }
 }
 
+static void hb_rf_usb_2_submit_read_urb(struct hb_rf_usb_2_port_s *port, struct urb *urb, gfp_t mem_flags)
+{
+  usb_anchor_urb(urb, &port->read_anchor);
+  if (usb_submit_urb(urb, mem_flags))
+  {
+    usb_unanchor_urb(urb);
+  }
+}
+
 static void hb_rf_usb_2_process_read_urb(struct urb *urb)
 {
   struct hb_rf_usb_2_port_s *port = urb->context;
 
   enum generic_raw_uart_rx_flags flags;
   unsigned char *data = (unsigned char *)urb->transfer_buffer;
+  unsigned char *event;
   unsigned char status;
   int i;
 
-  for (i = 0; i < urb->actual_length; i++)
+  /* URB was killed or the device is gone, do not resubmit */
+  if (urb->status == -ENOENT || urb->status == -ECONNRESET || urb->status == -ESHUTDOWN)
+  {
+    return;
+  }
+
+  i = 0;
+  while (i < urb->actual_length)
   {
-    if (data[i] == EMBED_EVENT_CHAR)
+    /* hand over plain data up to the next embedded event in one go */
+    event = memchr(data + i, EMBED_EVENT_CHAR, urb->actual_length - i);
+    if (!event)
+    {
+      generic_raw_uart_handle_rx_chars(port->raw_uart, data + i, urb->actual_length - i);
+      break;
+    }
+
+    if (event > data + i)
     {
+      generic_raw_uart_handle_rx_chars(port->raw_uart, data + i, event - (data + i));
+    }
+
+    i = event - data + 1;
+    switch (data[i])
+    {
+    case 0:
+      generic_raw_uart_handle_rx_char(port->raw_uart, GENERIC_RAW_UART_RX_STATE_NONE, EMBED_EVENT_CHAR);
+      break;
+    case 1:
+    case 2:
       i++;
-      switch (data[i])
-      {
-      case 0:
-        generic_raw_uart_handle_rx_char(port->raw_uart, GENERIC_RAW_UART_RX_STATE_NONE, EMBED_EVENT_CHAR);
-        break;
-      case 1:
-      case 2:
-        i++;
-        status = data[i];
-        flags = GENERIC_RAW_UART_RX_STATE_NONE;
+      status = data[i];
+      flags = GENERIC_RAW_UART_RX_STATE_NONE;
 
-        if (status & BIT(1))
-        {
-          flags |= GENERIC_RAW_UART_RX_STATE_OVERRUN;
-        }
-        if (status & BIT(2))
-        {
-          flags |= GENERIC_RAW_UART_RX_STATE_PARITY;
-        }
-        if (status & BIT(3))
-        {
-          flags |= GENERIC_RAW_UART_RX_STATE_FRAME;
-        }
-        if (status & BIT(4))
-        {
-          flags |= GENERIC_RAW_UART_RX_STATE_BREAK;
-        }
+      if (status & BIT(1))
+      {
+        flags |= GENERIC_RAW_UART_RX_STATE_OVERRUN;
+      }
+      if (status & BIT(2))
+      {
+        flags |= GENERIC_RAW_UART_RX_STATE_PARITY;
+      }
+      if (status & BIT(3))
+      {
+        flags |= GENERIC_RAW_UART_RX_STATE_FRAME;
+      }
+      if (status & BIT(4))
+      {
+        flags |= GENERIC_RAW_UART_RX_STATE_BREAK;
+      }
 
-        if (status & BIT(0))
-        {
-          i++;
-          generic_raw_uart_handle_rx_char(port->raw_uart, flags, data[i]);
-        }
-        else
-        {
-          generic_raw_uart_handle_rx_char(port->raw_uart, flags, 0);
-        }
-        break;
+      if (status & BIT(0))
+      {
+        i++;
+        generic_raw_uart_handle_rx_char(port->raw_uart, flags, data[i]);
       }
+      else
+      {
+        generic_raw_uart_handle_rx_char(port->raw_uart, flags, 0);
+      }
+      break;
     }
-    else
-    {
-      generic_raw_uart_handle_rx_char(port->raw_uart, GENERIC_RAW_UART_RX_STATE_NONE, (unsigned char)data[i]);
-    }
+    i++;
   }
 
   generic_raw_uart_rx_completed(port->raw_uart);
 
-  usb_submit_urb(port->read_urb, GFP_ATOMIC);
+  hb_rf_usb_2_submit_read_urb(port, urb, GFP_ATOMIC);
 }
 
 static void hb_rf_usb_2_process_write_urb(struct urb *urb)
@@ -336,6 +371,7 @@ static void hb_rf_usb_2_process_write_urb(struct urb *urb)
 static int hb_rf_usb_2_start_connection(struct generic_raw_uart *raw_uart)
 {
   struct hb_rf_usb_2_port_s *port = raw_uart->driver_data;
+  int i;
 
   kref_get(&port->kref);
 
@@ -344,7 +380,10 @@ static int hb_rf_usb_2_start_connection(struct generic_raw_uart *raw_uart)
   // set embedded event char
   usb_control_msg(port->udev, usb_sndctrlpipe(port->udev, 0), CP2102N_EMBED_EVENTS, REQTYPE_HOST_TO_INTERFACE, EMBED_EVENT_CHAR, 0, NULL, 0, USB_CTRL_SET_TIMEOUT);
 
-  usb_submit_urb(port->read_urb, GFP_KERNEL);
+  for (i = 0; i < port->read_urb_count; i++)
+  {
+    hb_rf_usb_2_submit_read_urb(port, port->read_urbs[i], GFP_KERNEL);
+  }
 
   return 0;
 }
@@ -354,7 +393,7 @@ static void hb_rf_usb_2_stop_connection(struct generic_raw_uart *raw_uart)
   struct hb_rf_usb_2_port_s *port = raw_uart->driver_data;
 
   usb_kill_urb(port->write_urb);
-  usb_kill_urb(port->read_urb);
+  usb_kill_anchored_urbs(&port->read_anchor);
 
   // clear fifo
   usb_control_msg(port->udev, usb_sndctrlpipe(port->udev, 0), CP2102N_PURGE, REQTYPE_HOST_TO_INTERFACE, PURGE_ALL, 0, NULL, 0, USB_CTRL_SET_TIMEOUT);
@@ -453,8 +492,8 @@ static struct raw_uart_driver hb_rf_usb_2 = {
     .tx_chars = hb_rf_usb_2_tx_chars,
     .stop_tx = hb_rf_usb_2_stop_tx,
     .get_device_type = hb_rf_usb_2_get_device_type,
-    .tx_chunk_size = TX_CHUNK_SIZE,
-    .tx_bulktransfer_size = TX_CHUNK_SIZE,
+    .tx_chunk_size = WRITE_BUFFER_SIZE,
+    .tx_bulktransfer_size = WRITE_BUFFER_SIZE,
 };
 
 static const char *hb_rf_usb_2_gpio_names[3] = { "HB-RF-USB-2 R_LED", "HB-RF-USB-2 G_LED", "HB-RF-USB-2 B_LED" };
@@ -565,6 +604,7 @@ static int hb_rf_usb_2_probe(struct usb_interface *interface, const struct usb_d
   port->part_num = part_num;
 
   spin_lock_init(&port->is_in_tx_lock);
+  init_usb_anchor(&port->read_anchor);
   spin_lock_init(&port->gpio_lock);
 
   if (part_num >= 0x20 && part_num <= 0x22)
@@ -608,7 +648,7 @@ static void hb_rf_usb_2_disconnect(struct usb_interface *interface)
   struct hb_rf_usb_2_port_s *port = usb_get_intfdata(interface);
 
   usb_kill_urb(port->write_urb);
-  usb_kill_urb(port->read_urb);
+  usb_kill_anchored_urbs(&port->read_anchor);
 
   if (port->part_num >= 0x20 && port->part_num <= 0x22)
   {
@@ -623,13 +663,17 @@ static void hb_rf_usb_2_disconnect(struct usb_interface *interface)
 static void hb_rf_usb_2_delete(struct kref *kref)
 {
   struct hb_rf_usb_2_port_s *port = container_of(kref, struct hb_rf_usb_2_port_s, kref);
+  int i;
 
   generic_raw_uart_remove(port->raw_uart);
 
   usb_free_urb(port->write_urb);
   kfree(port->write_buffer);
-  usb_free_urb(port->read_urb);
-  kfree(port->read_buffer);
+  for (i = 0; i < port->read_urb_count; i++)
+  {
+    usb_free_urb(port->read_urbs[i]);
+    kfree(port->read_buffers[i]);
+  }
 
   usb_put_intf(port->iface);
   usb_put_dev(port->udev);
@@ -664,6 +708,9 @@ static void __exit hb_rf_usb_2_exit(void)
 module_init(hb_rf_usb_2_init);
 module_exit(hb_rf_usb_2_exit);
 
+module_param(read_urbs, int, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(read_urbs, "Number of read URBs kept submitted per device (1-16), applied to newly connected devices");
+
 MODULE_LICENSE("GPL");
 MODULE_VERSION("1.17");
 MODULE_DESCRIPTION("HB-RF-USB-2 raw uart driver for communication of debmatic and piVCCU with the HM-MOD-RPI-PCB and RPI-RF-MOD radio modules");
@@ -17,6 +17,8 @@
  * along with this program; if not, write to the Free Software
  * Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA 02111-1307 USA
  *---------------------------------------------------------------------------*/
+#include "hm_crc.h"
+
 enum hm_dst
 {
   HM_DST_SYSTEM = 0x00,
@@ -69,31 +71,6 @@ enum hm_hmip_cmd
   HM_HMIP_SET_NWKEY = 0x14,
 };
 
-static uint16_t hm_crc(unsigned char *buf, size_t len)
-{
-  uint16_t crc = 0xd77f;
-  int i;
-
-  while (len--)
-  {
-    crc ^= *buf++ << 8;
-    for (i = 0; i < 8; i++)
-    {
-      if (crc & 0x8000)
-      {
-        crc <<= 1;
-        crc ^= 0x8005;
-      }
-      else
-      {
-        crc <<= 1;
-      }
-    }
-  }
-
-  return crc;
-}
-
 struct hm_frame
 {
   uint8_t dst;
@@ -102,7 +79,7 @@ struct hm_frame
   int cmdlen;
 };
 
-static bool tryParseFrame(unsigned char *buf, size_t len, struct hm_frame *frame)
+static inline bool tryParseFrame(unsigned char *buf, size_t len, struct hm_frame *frame)
 {
   uint16_t crc;
 
@@ -127,7 +104,7 @@ static bool tryParseFrame(unsigned char *buf, size_t len, struct hm_frame *frame
   return true;
 }
 
-static size_t encodeFrame(unsigned char *buf, size_t len, struct hm_frame *frame)
+static inline size_t encodeFrame(unsigned char *buf, size_t len, struct hm_frame *frame)
 {
   uint16_t crc;
 
@@ -148,7 +125,7 @@ static size_t encodeFrame(unsigned char *buf, size_t len, struct hm_frame *frame
   return frame->cmdlen + 7;
 }
 
-static size_t encodeFrameBuffer(unsigned char *src, unsigned char *dst, size_t len)
+static inline size_t encodeFrameBuffer(unsigned char *src, unsigned char *dst, size_t len)
 {
   size_t ret = 0;
   unsigned char cur;
@@ -169,7 +146,7 @@ static size_t encodeFrameBuffer(unsigned char *src, unsigned char *dst, size_t l
   return ret;
 }
 
-static size_t decodeFrameBuffer(unsigned char *src, unsigned char *dst, size_t len)
+static inline size_t decodeFrameBuffer(unsigned char *src, unsigned char *dst, size_t len)
 {
   size_t ret = 0;
   unsigned char cur;
@@ -39,6 +39,7 @@
 
 #define MODULE_NAME "meson_raw_uart"
 #define TX_CHUNK_SIZE 11
+#define MESON_FIFO_SIZE 64 /* smallest FIFO of all meson UARTs (uart_AO) */
 
 #define MESON_WFIFO 0x00
 #define MESON_RFIFO 0x04
@@ -49,6 +50,7 @@
 
 #define MESON_TX_FULL BIT(21)
 #define MESON_RX_EMPTY BIT(20)
+#define MESON_TX_CNT_MASK GENMASK(14, 8)
 
 #define MESON_RX_EN BIT(13)
 #define MESON_TX_EN BIT(12)
@@ -73,6 +75,7 @@ static int meson_raw_uart_start_connection(struct generic_raw_uart *raw_uart);
 static void meson_raw_uart_stop_connection(struct generic_raw_uart *raw_uart);
 static void meson_raw_uart_stop_tx(struct generic_raw_uart *raw_uart);
 static bool meson_raw_uart_isready_for_tx(struct generic_raw_uart *raw_uart);
+static int meson_raw_uart_tx_fifo_free(struct generic_raw_uart *raw_uart);
 static void meson_raw_uart_tx_chars(struct generic_raw_uart *raw_uart, unsigned char *chr, int index, int len);
 static void meson_raw_uart_init_tx(struct generic_raw_uart *raw_uart);
 static void meson_raw_uart_rx_chars(struct generic_raw_uart *raw_uart);
@@ -169,9 +172,29 @@ static bool meson_raw_uart_isready_for_tx(struct generic_raw_uart *raw_uart)
   return !(readl(meson_port->membase + MESON_STATUS) & MESON_TX_FULL);
 }
 
+static int meson_raw_uart_tx_fifo_free(struct generic_raw_uart *raw_uart)
+{
+  unsigned long status;
+  int tx_count;
+
+  status = readl(meson_port->membase + MESON_STATUS);
+  if (status & MESON_TX_FULL)
+  {
+    return 0;
+  }
+
+  tx_count = (status & MESON_TX_CNT_MASK) >> 8;
+  return max(MESON_FIFO_SIZE - tx_count, 0);
+}
+
 static void meson_raw_uart_tx_chars(struct generic_raw_uart *raw_uart, unsigned char *chr, int index, int len)
 {
-  writel(chr[index], meson_port->membase + MESON_WFIFO);
+  int i;
+
+  for (i = 0; i < len; i++)
+  {
+    writel(chr[index + i], meson_port->membase + MESON_WFIFO);
+  }
 }
 
 static void meson_raw_uart_init_tx(struct generic_raw_uart *raw_uart)
@@ -259,10 +282,11 @@ static struct raw_uart_driver meson_raw_uart = {
     .stop_connection = meson_raw_uart_stop_connection,
     .init_tx = meson_raw_uart_init_tx,
     .isready_for_tx = meson_raw_uart_isready_for_tx,
+    .tx_fifo_free = meson_raw_uart_tx_fifo_free,
     .tx_chars = meson_raw_uart_tx_chars,
     .stop_tx = meson_raw_uart_stop_tx,
     .tx_chunk_size = TX_CHUNK_SIZE,
-    .tx_bulktransfer_size = 1,
+    .tx_bulktransfer_size = MESON_FIFO_SIZE,
 };
 
 static inline struct clk *meson_raw_uart_probe_clk(struct device *dev, const char *id)
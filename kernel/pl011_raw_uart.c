@@ -31,6 +31,9 @@
 #include <linux/interrupt.h>
 #include <linux/sched.h>
 #include <linux/amba/serial.h>
+#include <linux/dmaengine.h>
+#include <linux/dma-mapping.h>
+#include <linux/hrtimer.h>
 #include <linux/version.h>
 
 #include "generic_raw_uart.h"
@@ -39,14 +42,24 @@
 
 #define MODULE_NAME "pl011_raw_uart"
 #define TX_CHUNK_SIZE 11
+#define PL011_FIFO_SIZE 16
+#define PL011_DMA_RX_BUF_SIZE 4096
+#define PL011_DMA_RX_PERIOD_SIZE 1024
+#define PL011_DMA_TX_BUF_SIZE 4096
+#define PL011_DMA_BURST (PL011_FIFO_SIZE / 2)
+#define PL011_DMA_RX_POLL_MS 10
 
 static int pl011_raw_uart_start_connection(struct generic_raw_uart *raw_uart);
 static void pl011_raw_uart_stop_connection(struct generic_raw_uart *raw_uart);
 static void pl011_raw_uart_stop_tx(struct generic_raw_uart *raw_uart);
 static bool pl011_raw_uart_isready_for_tx(struct generic_raw_uart *raw_uart);
+static int pl011_raw_uart_tx_fifo_free(struct generic_raw_uart *raw_uart);
 static void pl011_raw_uart_tx_chars(struct generic_raw_uart *raw_uart, unsigned char *chr, int index, int len);
 static void pl011_raw_uart_init_tx(struct generic_raw_uart *raw_uart);
 static void pl011_raw_uart_rx_chars(struct generic_raw_uart *raw_uart);
+static int pl011_raw_uart_dma_start(struct generic_raw_uart *raw_uart);
+static void pl011_raw_uart_dma_stop(struct generic_raw_uart *raw_uart);
+static void pl011_raw_uart_dma_rx_timeout(struct generic_raw_uart *raw_uart);
 static irqreturn_t pl011_raw_uart_irq_handle(int irq, void *context);
 static int pl011_raw_uart_probe(struct platform_device *pdev);
 static int pl011_raw_uart_remove(struct platform_device *pdev);
@@ -58,10 +71,36 @@ struct pl011_port_s
   unsigned long mapbase; /*physical address of UART registers*/
   void __iomem *membase; /*logical address of UART registers*/
   unsigned long irq;     /*interrupt number*/
+  bool tx_fifo_low;      /*TX interrupt seen, FIFO is at or below trigger level*/
+
+  struct dma_chan *dma_rx_chan; /*RX DMA channel, NULL if RX uses PIO*/
+  unsigned char *dma_rx_buf;    /*cyclic RX DMA buffer*/
+  dma_addr_t dma_rx_addr;
+  dma_cookie_t dma_rx_cookie;
+  size_t dma_rx_pos;            /*position in dma_rx_buf up to which data was handed to generic_raw_uart*/
+  spinlock_t dma_rx_lock;       /*serializes the DMA callback against the RX timeout interrupt and the poll timer*/
+  struct hrtimer dma_rx_poll_timer; /*hands over DMA RX data if a burst emptied the FIFO, so no RX timeout fires*/
+  struct generic_raw_uart *dma_rx_raw_uart; /*raw uart passed to generic_raw_uart by the poll timer*/
+
+  struct dma_chan *dma_tx_chan; /*TX DMA channel, NULL if TX uses PIO*/
+  unsigned char *dma_tx_buf;    /*TX bounce buffer, the connection buffer may be reused once the generic layer completed it*/
+  dma_addr_t dma_tx_addr;
+  bool dma_tx_busy;             /*TX DMA transfer in flight, protected by the generic TX lock*/
+  bool dma_tx_failed;           /*TX DMA could not be submitted, TX continues by PIO*/
+  spinlock_t tx_pio_lock;       /*protects tx_pio_pos and tx_pio_len*/
+  int tx_pio_pos;               /*next byte in dma_tx_buf to be sent by PIO after a failed TX DMA transfer*/
+  int tx_pio_len;               /*number of bytes in dma_tx_buf still to be sent by PIO*/
 };
 
 static struct pl011_port_s *pl011_port;
 
+static bool use_dma = false;
+
+static inline bool pl011_raw_uart_tx_dma_active(void)
+{
+  return pl011_port->dma_tx_chan && !pl011_port->dma_tx_failed;
+}
+
 static int pl011_raw_uart_start_connection(struct generic_raw_uart *raw_uart)
 {
   int ret = 0;
@@ -85,6 +124,11 @@ static int pl011_raw_uart_start_connection(struct generic_raw_uart *raw_uart)
     return ret;
   }
 
+  if (use_dma && pl011_raw_uart_dma_start(raw_uart))
+  {
+    dev_warn(pl011_port->dev, "DMA not available, falling back to PIO");
+  }
+
   /* enable RX and TX, set RX FIFO threshold to lowest and TX FIFO threshold to mid */
   /*If uart is enabled, wait until it is not busy*/
   while ((readl(pl011_port->membase + UART011_CR) & UART01x_CR_UARTEN) && (readl(pl011_port->membase + UART01x_FR) & UART01x_FR_BUSY))
@@ -102,8 +146,8 @@ static int pl011_raw_uart_start_connection(struct generic_raw_uart *raw_uart)
   /*Flush fifo*/
   writel(0, pl011_port->membase + UART011_LCRH);
 
-  /*Set RX FIFO threshold to lowest and TX FIFO threshold to mid*/
-  writel(UART011_IFLS_RX1_8 | UART011_IFLS_TX2_8, pl011_port->membase + UART011_IFLS);
+  /*Set RX FIFO threshold to lowest (DMA: half full) and TX FIFO threshold to mid*/
+  writel((pl011_port->dma_rx_chan ? UART011_IFLS_RX4_8 : UART011_IFLS_RX1_8) | UART011_IFLS_TX2_8, pl011_port->membase + UART011_IFLS);
 
   /*enable RX and TX*/
   uart_cr |= UART011_CR_RXE | UART011_CR_TXE;
@@ -116,8 +160,11 @@ static int pl011_raw_uart_start_connection(struct generic_raw_uart *raw_uart)
   uart_cr |= UART01x_CR_UARTEN;
   writel(uart_cr, pl011_port->membase + UART011_CR);
 
+  /*Enable DMA requests, RX data is fetched by DMA and only the RX timeout interrupt is needed*/
+  writel((pl011_port->dma_rx_chan ? UART011_RXDMAE : 0) | (pl011_raw_uart_tx_dma_active() ? UART011_TXDMAE : 0), pl011_port->membase + UART011_DMACR);
+
   /*Configure interrupts*/
-  writel(UART011_OEIM | UART011_BEIM | UART011_FEIM | UART011_RTIM | UART011_RXIM, pl011_port->membase + UART011_IMSC);
+  writel(UART011_OEIM | UART011_BEIM | UART011_FEIM | UART011_RTIM | (pl011_port->dma_rx_chan ? 0 : UART011_RXIM), pl011_port->membase + UART011_IMSC);
 
   return 0;
 }
@@ -134,13 +181,280 @@ static void pl011_raw_uart_stop_connection(struct generic_raw_uart *raw_uart)
 
   writel(0, pl011_port->membase + UART011_IMSC); /*Disable interrupts*/
 
+  writel(0, pl011_port->membase + UART011_DMACR); /*Disable DMA requests*/
+
   free_irq(pl011_port->irq, raw_uart);
+
+  pl011_raw_uart_dma_stop(raw_uart);
+}
+
+static void pl011_raw_uart_dma_rx_push(struct generic_raw_uart *raw_uart)
+{
+  struct dma_tx_state state;
+  size_t pos;
+
+  dmaengine_tx_status(pl011_port->dma_rx_chan, pl011_port->dma_rx_cookie, &state);
+
+  pos = (PL011_DMA_RX_BUF_SIZE - state.residue) % PL011_DMA_RX_BUF_SIZE;
+
+  if (pos < pl011_port->dma_rx_pos)
+  {
+    generic_raw_uart_handle_rx_chars(raw_uart, pl011_port->dma_rx_buf + pl011_port->dma_rx_pos, PL011_DMA_RX_BUF_SIZE - pl011_port->dma_rx_pos);
+    pl011_port->dma_rx_pos = 0;
+  }
+
+  if (pos > pl011_port->dma_rx_pos)
+  {
+    generic_raw_uart_handle_rx_chars(raw_uart, pl011_port->dma_rx_buf + pl011_port->dma_rx_pos, pos - pl011_port->dma_rx_pos);
+    pl011_port->dma_rx_pos = pos;
+  }
+}
+
+static void pl011_raw_uart_dma_rx_callback(void *param)
+{
+  struct generic_raw_uart *raw_uart = param;
+  unsigned long flags;
+
+  spin_lock_irqsave(&pl011_port->dma_rx_lock, flags);
+  pl011_raw_uart_dma_rx_push(raw_uart);
+  spin_unlock_irqrestore(&pl011_port->dma_rx_lock, flags);
+
+  generic_raw_uart_rx_completed(raw_uart);
+}
+
+static void pl011_raw_uart_dma_rx_timeout(struct generic_raw_uart *raw_uart)
+{
+  unsigned long flags;
+
+  /*
+   * The RX timeout fires if less than a DMA burst is left in the FIFO and no further data arrived.
+   * Pause the channel, so a burst which is already in flight lands before the residue is read, take
+   * everything the DMA transferred and drain the rest of the FIFO by PIO while RX DMA requests are
+   * disabled to keep the byte order.
+   */
+  spin_lock_irqsave(&pl011_port->dma_rx_lock, flags);
+
+  dmaengine_pause(pl011_port->dma_rx_chan);
+  writel(pl011_raw_uart_tx_dma_active() ? UART011_TXDMAE : 0, pl011_port->membase + UART011_DMACR);
+  pl011_raw_uart_dma_rx_push(raw_uart);
+  pl011_raw_uart_rx_chars(raw_uart);
+  writel(UART011_RXDMAE | (pl011_raw_uart_tx_dma_active() ? UART011_TXDMAE : 0), pl011_port->membase + UART011_DMACR);
+  dmaengine_resume(pl011_port->dma_rx_chan);
+
+  spin_unlock_irqrestore(&pl011_port->dma_rx_lock, flags);
+}
+
+static enum hrtimer_restart pl011_raw_uart_dma_rx_poll_timer_fn(struct hrtimer *timer)
+{
+  unsigned long flags;
+  size_t pos;
+  bool received;
+
+  /*
+   * If a DMA burst emptied the FIFO, the RX timeout does not fire and the data would stay in the
+   * cyclic buffer until the period is completed.
+   */
+  spin_lock_irqsave(&pl011_port->dma_rx_lock, flags);
+  pos = pl011_port->dma_rx_pos;
+  pl011_raw_uart_dma_rx_push(pl011_port->dma_rx_raw_uart);
+  received = pos != pl011_port->dma_rx_pos;
+  spin_unlock_irqrestore(&pl011_port->dma_rx_lock, flags);
+
+  if (received)
+    generic_raw_uart_rx_completed(pl011_port->dma_rx_raw_uart);
+
+  hrtimer_forward_now(timer, ms_to_ktime(PL011_DMA_RX_POLL_MS));
+  return HRTIMER_RESTART;
+}
+
+static void pl011_raw_uart_dma_tx_callback(void *param)
+{
+  struct generic_raw_uart *raw_uart = param;
+
+  pl011_port->dma_tx_busy = false;
+  smp_wmb();
+
+  generic_raw_uart_tx_queued(raw_uart);
+}
+
+static int pl011_raw_uart_dma_start_rx(struct generic_raw_uart *raw_uart)
+{
+  struct dma_chan *chan;
+  struct dma_async_tx_descriptor *desc;
+  struct dma_slave_caps caps;
+  struct dma_slave_config config = {
+      .direction = DMA_DEV_TO_MEM,
+      .src_addr = pl011_port->mapbase + UART01x_DR,
+      .src_addr_width = DMA_SLAVE_BUSWIDTH_1_BYTE,
+      .src_maxburst = PL011_DMA_BURST,
+  };
+
+  chan = dma_request_chan(pl011_port->dev, "rx");
+  if (IS_ERR(chan))
+  {
+    return PTR_ERR(chan);
+  }
+
+  /*the RX timeout handling needs to pause the channel and to read an exact residue*/
+  if (dma_get_slave_caps(chan, &caps) || !caps.cmd_pause || caps.residue_granularity == DMA_RESIDUE_GRANULARITY_DESCRIPTOR)
+  {
+    goto failed_config;
+  }
+
+  if (dmaengine_slave_config(chan, &config))
+  {
+    goto failed_config;
+  }
+
+  pl011_port->dma_rx_buf = dma_alloc_coherent(chan->device->dev, PL011_DMA_RX_BUF_SIZE, &pl011_port->dma_rx_addr, GFP_KERNEL);
+  if (!pl011_port->dma_rx_buf)
+  {
+    goto failed_config;
+  }
+
+  desc = dmaengine_prep_dma_cyclic(chan, pl011_port->dma_rx_addr, PL011_DMA_RX_BUF_SIZE, PL011_DMA_RX_PERIOD_SIZE, DMA_DEV_TO_MEM, DMA_PREP_INTERRUPT);
+  if (!desc)
+  {
+    goto failed_prep;
+  }
+
+  desc->callback = pl011_raw_uart_dma_rx_callback;
+  desc->callback_param = raw_uart;
+
+  pl011_port->dma_rx_pos = 0;
+  pl011_port->dma_rx_cookie = dmaengine_submit(desc);
+  if (dma_submit_error(pl011_port->dma_rx_cookie))
+  {
+    goto failed_prep;
+  }
+
+  pl011_port->dma_rx_chan = chan;
+  pl011_port->dma_rx_raw_uart = raw_uart;
+  dma_async_issue_pending(chan);
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+  hrtimer_setup(&pl011_port->dma_rx_poll_timer, pl011_raw_uart_dma_rx_poll_timer_fn, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+#else
+  hrtimer_init(&pl011_port->dma_rx_poll_timer, CLOCK_MONOTONIC, HRTIMER_MODE_REL);
+  pl011_port->dma_rx_poll_timer.function = pl011_raw_uart_dma_rx_poll_timer_fn;
+#endif
+  hrtimer_start(&pl011_port->dma_rx_poll_timer, ms_to_ktime(PL011_DMA_RX_POLL_MS), HRTIMER_MODE_REL);
+
+  return 0;
+
+failed_prep:
+  dma_free_coherent(chan->device->dev, PL011_DMA_RX_BUF_SIZE, pl011_port->dma_rx_buf, pl011_port->dma_rx_addr);
+  pl011_port->dma_rx_buf = NULL;
+failed_config:
+  dma_release_channel(chan);
+  return -EIO;
+}
+
+static int pl011_raw_uart_dma_start_tx(struct generic_raw_uart *raw_uart)
+{
+  struct dma_chan *chan;
+  struct dma_slave_config config = {
+      .direction = DMA_MEM_TO_DEV,
+      .dst_addr = pl011_port->mapbase + UART01x_DR,
+      .dst_addr_width = DMA_SLAVE_BUSWIDTH_1_BYTE,
+      .dst_maxburst = PL011_DMA_BURST,
+  };
+
+  chan = dma_request_chan(pl011_port->dev, "tx");
+  if (IS_ERR(chan))
+  {
+    return PTR_ERR(chan);
+  }
+
+  if (dmaengine_slave_config(chan, &config))
+  {
+    goto failed_config;
+  }
+
+  pl011_port->dma_tx_buf = dma_alloc_coherent(chan->device->dev, PL011_DMA_TX_BUF_SIZE, &pl011_port->dma_tx_addr, GFP_KERNEL);
+  if (!pl011_port->dma_tx_buf)
+  {
+    goto failed_config;
+  }
+
+  pl011_port->dma_tx_busy = false;
+  pl011_port->dma_tx_failed = false;
+  pl011_port->tx_pio_len = 0;
+  pl011_port->dma_tx_chan = chan;
+
+  return 0;
+
+failed_config:
+  dma_release_channel(chan);
+  return -EIO;
+}
+
+static int pl011_raw_uart_dma_start(struct generic_raw_uart *raw_uart)
+{
+  int err_rx;
+  int err_tx;
+
+  err_rx = pl011_raw_uart_dma_start_rx(raw_uart);
+  err_tx = pl011_raw_uart_dma_start_tx(raw_uart);
+
+  dev_info(pl011_port->dev, "using %s for RX and %s for TX", err_rx ? "PIO" : "DMA", err_tx ? "PIO" : "DMA");
+
+  return (err_rx && err_tx) ? -ENODEV : 0;
+}
+
+static void pl011_raw_uart_dma_stop(struct generic_raw_uart *raw_uart)
+{
+  if (pl011_port->dma_rx_chan)
+  {
+    hrtimer_cancel(&pl011_port->dma_rx_poll_timer);
+    dmaengine_terminate_sync(pl011_port->dma_rx_chan);
+    dma_free_coherent(pl011_port->dma_rx_chan->device->dev, PL011_DMA_RX_BUF_SIZE, pl011_port->dma_rx_buf, pl011_port->dma_rx_addr);
+    dma_release_channel(pl011_port->dma_rx_chan);
+    pl011_port->dma_rx_chan = NULL;
+    pl011_port->dma_rx_buf = NULL;
+  }
+
+  if (pl011_port->dma_tx_chan)
+  {
+    dmaengine_terminate_sync(pl011_port->dma_tx_chan);
+    dma_free_coherent(pl011_port->dma_tx_chan->device->dev, PL011_DMA_TX_BUF_SIZE, pl011_port->dma_tx_buf, pl011_port->dma_tx_addr);
+    dma_release_channel(pl011_port->dma_tx_chan);
+    pl011_port->dma_tx_chan = NULL;
+    pl011_port->dma_tx_buf = NULL;
+    pl011_port->dma_tx_busy = false;
+    pl011_port->dma_tx_failed = false;
+    pl011_port->tx_pio_len = 0;
+  }
+}
+
+/*
+ * Sends the bytes left in the TX bounce buffer after a failed TX DMA transfer, as far as they fit
+ * into the FIFO. Returns the number of bytes written. Must be called with tx_pio_lock held.
+ */
+static int pl011_raw_uart_tx_pio_drain(void)
+{
+  int count = 0;
+
+  while (pl011_port->tx_pio_len && !(readl(pl011_port->membase + UART01x_FR) & UART01x_FR_TXFF))
+  {
+    writel(pl011_port->dma_tx_buf[pl011_port->tx_pio_pos++], pl011_port->membase + UART01x_DR);
+    pl011_port->tx_pio_len--;
+    count++;
+  }
+
+  return count;
 }
 
 static void pl011_raw_uart_stop_tx(struct generic_raw_uart *raw_uart)
 {
   unsigned long imsc;
 
+  /*the TX interrupt still drives the PIO fallback of a failed TX DMA transfer*/
+  if (READ_ONCE(pl011_port->tx_pio_len))
+  {
+    return;
+  }
+
   /*Diable TX interrupts*/
   imsc = readl(pl011_port->membase + UART011_IMSC);
   imsc &= ~(UART011_DSRMIM | UART011_DCDMIM | UART011_RIMIM); /*Set all RO bit to 0*/
@@ -154,15 +468,105 @@ static bool pl011_raw_uart_isready_for_tx(struct generic_raw_uart *raw_uart)
   return !(readl(pl011_port->membase + UART01x_FR) & UART01x_FR_TXFF);
 }
 
+static int pl011_raw_uart_tx_fifo_free(struct generic_raw_uart *raw_uart)
+{
+  unsigned long status;
+  bool pio_busy;
+
+  if (pl011_raw_uart_tx_dma_active())
+  {
+    return pl011_port->dma_tx_busy ? 0 : PL011_DMA_TX_BUF_SIZE;
+  }
+
+  if (READ_ONCE(pl011_port->tx_pio_len))
+  {
+    /*the rest of a failed TX DMA transfer goes first, the FIFO level is unknown afterwards*/
+    spin_lock(&pl011_port->tx_pio_lock);
+    pio_busy = pl011_raw_uart_tx_pio_drain() || pl011_port->tx_pio_len;
+    spin_unlock(&pl011_port->tx_pio_lock);
+
+    if (pio_busy)
+    {
+      pl011_port->tx_fifo_low = false;
+      return 0;
+    }
+  }
+
+  /* the FIFO level is not readable, so derive the free space from the flags and the TX interrupt */
+  status = readl(pl011_port->membase + UART01x_FR);
+
+  if (status & UART01x_FR_TXFE)
+  {
+    pl011_port->tx_fifo_low = false;
+    return PL011_FIFO_SIZE;
+  }
+
+  if (pl011_port->tx_fifo_low)
+  {
+    pl011_port->tx_fifo_low = false;
+    return TX_CHUNK_SIZE; /* FIFO size minus TX trigger level (UART011_IFLS_TX2_8) with one byte headroom */
+  }
+
+  return (status & UART01x_FR_TXFF) ? 0 : 1;
+}
+
 static void pl011_raw_uart_tx_chars(struct generic_raw_uart *raw_uart, unsigned char *chr, int index, int len)
 {
-  writel(chr[index], pl011_port->membase + UART01x_DR);
+  int i;
+  struct dma_async_tx_descriptor *desc;
+
+  if (pl011_raw_uart_tx_dma_active())
+  {
+    memcpy(pl011_port->dma_tx_buf, chr + index, len);
+
+    desc = dmaengine_prep_slave_single(pl011_port->dma_tx_chan, pl011_port->dma_tx_addr, len, DMA_MEM_TO_DEV, DMA_PREP_INTERRUPT);
+    if (desc)
+    {
+      desc->callback = pl011_raw_uart_dma_tx_callback;
+      desc->callback_param = raw_uart;
+
+      if (!dma_submit_error(dmaengine_submit(desc)))
+      {
+        pl011_port->dma_tx_busy = true;
+        dma_async_issue_pending(pl011_port->dma_tx_chan);
+        return;
+      }
+    }
+
+    dev_err(pl011_port->dev, "TX DMA failed, continuing by PIO");
+
+    /*
+     * Never spin on the FIFO for a whole chunk here, this runs in atomic context. Disable TX DMA,
+     * send what fits into the FIFO now and leave the rest of the bounce buffer to the TX interrupt.
+     */
+    spin_lock(&pl011_port->tx_pio_lock);
+    pl011_port->dma_tx_failed = true;
+    pl011_port->tx_pio_pos = 0;
+    pl011_port->tx_pio_len = len;
+    pl011_raw_uart_tx_pio_drain();
+    spin_unlock(&pl011_port->tx_pio_lock);
+
+    writel(pl011_port->dma_rx_chan ? UART011_RXDMAE : 0, pl011_port->membase + UART011_DMACR);
+    pl011_raw_uart_init_tx(raw_uart);
+    return;
+  }
+
+  for (i = 0; i < len; i++)
+  {
+    writel(chr[index + i], pl011_port->membase + UART01x_DR);
+  }
 }
 
 static void pl011_raw_uart_init_tx(struct generic_raw_uart *raw_uart)
 {
   unsigned long imsc;
 
+  /*TX DMA completion drives the transmission, no TX interrupt needed*/
+  if (pl011_raw_uart_tx_dma_active())
+  {
+    return;
+  }
+
   /*Clear TX interrupts*/
   writel(UART011_TXIC, pl011_port->membase + UART011_ICR);
 
@@ -232,13 +636,29 @@ static irqreturn_t pl011_raw_uart_irq_handle(int irq, void *context)
 
   writel(istat, pl011_port->membase + UART011_ICR);
 
-  if (istat & (UART011_RXIS | UART011_RTIS))
+  if (pl011_port->dma_rx_chan && (istat & UART011_RTIS))
+  {
+    pl011_raw_uart_dma_rx_timeout(raw_uart);
+  }
+  else if (istat & (UART011_RXIS | UART011_RTIS))
   {
     pl011_raw_uart_rx_chars(raw_uart);
   }
 
   if (istat & UART011_TXIS)
   {
+    pl011_port->tx_fifo_low = true;
+
+    if (READ_ONCE(pl011_port->tx_pio_len))
+    {
+      spin_lock(&pl011_port->tx_pio_lock);
+      if (pl011_raw_uart_tx_pio_drain())
+      {
+        pl011_port->tx_fifo_low = false;
+      }
+      spin_unlock(&pl011_port->tx_pio_lock);
+    }
+
     generic_raw_uart_tx_queued(raw_uart);
   }
 
@@ -251,10 +671,11 @@ static struct raw_uart_driver pl011_raw_uart = {
     .stop_connection = pl011_raw_uart_stop_connection,
     .init_tx = pl011_raw_uart_init_tx,
     .isready_for_tx = pl011_raw_uart_isready_for_tx,
+    .tx_fifo_free = pl011_raw_uart_tx_fifo_free,
     .tx_chars = pl011_raw_uart_tx_chars,
     .stop_tx = pl011_raw_uart_stop_tx,
     .tx_chunk_size = TX_CHUNK_SIZE,
-    .tx_bulktransfer_size = 1,
+    .tx_bulktransfer_size = PL011_DMA_TX_BUF_SIZE, /*bounded by pl011_raw_uart_tx_fifo_free in PIO mode*/
 };
 
 static int pl011_raw_uart_probe(struct platform_device *pdev)
@@ -305,6 +726,8 @@ static int pl011_raw_uart_probe(struct platform_device *pdev)
   clk_prepare_enable(pl011_port->clk);
 
   pl011_port->dev = dev;
+  spin_lock_init(&pl011_port->dma_rx_lock);
+  spin_lock_init(&pl011_port->tx_pio_lock);
 
   dev_info(dev, "Initialized pl011 device; mapbase=0x%08lx; irq=%lu; clockrate=%lu", pl011_port->mapbase, pl011_port->irq, clk_get_rate(pl011_port->clk));
 
@@ -330,6 +753,9 @@ static struct of_device_id pl011_raw_uart_of_match[] = {
 
 module_raw_uart_driver(MODULE_NAME, pl011_raw_uart, pl011_raw_uart_of_match);
 
+module_param(use_dma, bool, S_IRUGO | S_IWUSR);
+MODULE_PARM_DESC(use_dma, "Use DMA for RX and TX if the UART has DMA channels assigned, applied on the next open");
+
 MODULE_ALIAS("platform:pl011-raw-uart");
 MODULE_LICENSE("GPL");
 MODULE_VERSION("1.11");